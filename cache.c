@@ -0,0 +1,102 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <cedrus/cedrus.h>
+#include "vdpau_private.h"
+
+static uint64_t flushed_bytes;
+static uint64_t flushed_buffers;
+
+#ifdef __aarch64__
+static uintptr_t dcache_line_size(void)
+{
+	static uintptr_t line_size;
+
+	if (!line_size)
+	{
+		uint64_t ctr;
+		__asm__ volatile ("mrs %0, ctr_el0" : "=r" (ctr));
+		line_size = 4 << ((ctr >> 16) & 0xf);
+	}
+
+	return line_size;
+}
+#endif
+
+/*
+ * Clean and invalidate the CPU cache for [offset, offset + size) of mem.
+ * Used after CPU writes before hardware reads the buffer, and before CPU
+ * reads of data the hardware has written. Only arm64 can do this by
+ * range, on 32-bit ARM libcedrus flushes the whole buffer and 1 is
+ * returned, the kernel's cacheflush() doesn't reach the point of coherency.
+ */
+int cache_flush_range(cedrus_mem_t *mem, size_t offset, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+#ifdef __aarch64__
+	// EL0 is allowed to do cache maintenance by VA on arm64 linux
+	uintptr_t line = dcache_line_size();
+	uintptr_t addr = (uintptr_t)cedrus_mem_get_pointer(mem) + offset;
+	uintptr_t end = addr + size;
+
+	addr &= ~(line - 1);
+	__atomic_add_fetch(&flushed_bytes, ((end + line - 1) & ~(line - 1)) - addr, __ATOMIC_RELAXED);
+
+	for (; addr < end; addr += line)
+		__asm__ volatile ("dc civac, %0" : : "r" (addr) : "memory");
+	__asm__ volatile ("dsb sy" : : : "memory");
+
+	return 0;
+#else
+	// libcedrus only offers whole-buffer maintenance on 32bit ARM
+	cedrus_mem_flush_cache(mem);
+	__atomic_add_fetch(&flushed_buffers, 1, __ATOMIC_RELAXED);
+
+	return 1;
+#endif
+}
+
+// cache lines flushed by range so far, for debugging
+uint64_t cache_flushed_bytes(void)
+{
+	return __atomic_load_n(&flushed_bytes, __ATOMIC_RELAXED);
+}
+
+// whole buffers flushed so far, libcedrus doesn't tell their size
+uint64_t cache_flushed_buffers(void)
+{
+	return __atomic_load_n(&flushed_buffers, __ATOMIC_RELAXED);
+}
+
+VdpStatus vdp_sunxi_cache_statistics(VdpDevice device,
+                                     uint64_t *bytes,
+                                     uint64_t *buffers)
+{
+	if (!handle_get(device))
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (!bytes || !buffers)
+		return VDP_STATUS_INVALID_POINTER;
+
+	*bytes = cache_flushed_bytes();
+	*buffers = cache_flushed_buffers();
+
+	return VDP_STATUS_OK;
+}
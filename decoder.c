@@ -146,10 +146,13 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
 	if (!vid)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	if (vid->mapped)
+		return VDP_STATUS_ERROR;
+
 	if (cedrus_get_ve_version(dec->device->cedrus) >= 0x1680)
-		vid->source_format = VDP_YCBCR_FORMAT_YV12;
+		video_surface_set_format(vid, VDP_YCBCR_FORMAT_YV12);
 	else
-		vid->source_format = INTERNAL_YCBCR_FORMAT;
+		video_surface_set_format(vid, INTERNAL_YCBCR_FORMAT);
 
 	unsigned int i, pos = 0;
 
@@ -158,7 +161,7 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
 		memcpy(cedrus_mem_get_pointer(dec->data) + pos, bitstream_buffers[i].bitstream, bitstream_buffers[i].bitstream_bytes);
 		pos += bitstream_buffers[i].bitstream_bytes;
 	}
-	cedrus_mem_flush_cache(dec->data);
+	cache_flush_range(dec->data, 0, pos);
 
 	return dec->decode(dec, picture_info, pos, vid);
 }
@@ -0,0 +1,166 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "deinterlace.h"
+#include "thread_pool.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#define DEINTERLACE_MAX_JOBS (3 * (MAX_WORKER_THREADS + 1))
+
+/*
+ * One missing line, yadif without the edge directed search: the spatial
+ * guess from the lines above and below is limited to the temporal one
+ * plus or minus the motion seen around the pixel, so still areas keep
+ * the full vertical resolution and moving ones don't comb.
+ */
+static void filter_row(uint8_t *dst, const uint8_t *above, const uint8_t *below,
+                       const uint8_t *prev, const uint8_t *next,
+                       const uint8_t *prev2_above, const uint8_t *prev2_below,
+                       const uint8_t *next2_above, const uint8_t *next2_below,
+                       unsigned int n)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= n; i += 16)
+	{
+		uint8x16_t c = vld1q_u8(above + i);
+		uint8x16_t e = vld1q_u8(below + i);
+		uint8x16_t p = vld1q_u8(prev + i);
+		uint8x16_t q = vld1q_u8(next + i);
+
+		uint8x16_t temporal = vrhaddq_u8(p, q);
+		uint8x16_t diff = vshrq_n_u8(vabdq_u8(p, q), 1);
+		diff = vmaxq_u8(diff, vhaddq_u8(vabdq_u8(vld1q_u8(prev2_above + i), c),
+		                                vabdq_u8(vld1q_u8(prev2_below + i), e)));
+		diff = vmaxq_u8(diff, vhaddq_u8(vabdq_u8(vld1q_u8(next2_above + i), c),
+		                                vabdq_u8(vld1q_u8(next2_below + i), e)));
+
+		uint8x16_t spatial = vrhaddq_u8(c, e);
+		spatial = vmaxq_u8(spatial, vqsubq_u8(temporal, diff));
+		vst1q_u8(dst + i, vminq_u8(spatial, vqaddq_u8(temporal, diff)));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		int c = above[i], e = below[i];
+		int temporal = (prev[i] + next[i] + 1) >> 1;
+		int diff = abs(prev[i] - next[i]) >> 1;
+		diff = max(diff, (abs(prev2_above[i] - c) + abs(prev2_below[i] - e)) >> 1);
+		diff = max(diff, (abs(next2_above[i] - c) + abs(next2_below[i] - e)) >> 1);
+
+		int spatial = (c + e + 1) >> 1;
+		spatial = max(spatial, temporal - diff);
+		dst[i] = min(spatial, temporal + diff);
+	}
+}
+
+struct deinterlace_job
+{
+	const uint8_t *src[5];
+	uint8_t *dst;
+	uint32_t pitch, bytes, height;
+	uint32_t y0, y1;
+	int parity;
+};
+
+struct deinterlace_ctx
+{
+	unsigned int num_jobs;
+	struct deinterlace_job jobs[DEINTERLACE_MAX_JOBS];
+};
+
+static void deinterlace_job_run(void *arg, unsigned int index)
+{
+	struct deinterlace_job *job = &((struct deinterlace_ctx *)arg)->jobs[index];
+	const uint8_t *cur = job->src[2];
+	// without frames two fields away the motion is only judged from prev and next
+	const uint8_t *prev2 = job->src[0] ? job->src[0] : cur;
+	const uint8_t *next2 = job->src[4] ? job->src[4] : cur;
+	uint32_t y;
+
+	for (y = job->y0; y < job->y1; y++)
+	{
+		uint8_t *dst = job->dst + y * job->pitch;
+
+		if ((int)(y & 1) == job->parity)
+		{
+			memcpy(dst, cur + y * job->pitch, job->bytes);
+			continue;
+		}
+
+		// lines of the shown field around the missing one, mirrored at the edges
+		uint32_t above = (y > 0 ? y - 1 : y + 1) * job->pitch;
+		uint32_t below = (y + 1 < job->height ? y + 1 : y - 1) * job->pitch;
+
+		filter_row(dst, cur + above, cur + below,
+		           job->src[1] + y * job->pitch, job->src[3] + y * job->pitch,
+		           prev2 + above, prev2 + below, next2 + above, next2 + below,
+		           job->bytes);
+	}
+}
+
+// split a plane into up to num_parts jobs of consecutive lines
+static void deinterlace_add_jobs(struct deinterlace_ctx *ctx, unsigned int num_parts,
+                                 const uint8_t *const frames[5], uint8_t *dst,
+                                 const plane_layout_t *plane, uint32_t bytes,
+                                 uint32_t height, int parity)
+{
+	uint32_t lines_per_job = DIV_ROUND_UP(height, num_parts);
+	uint32_t y;
+	int i;
+
+	for (y = 0; y < height; y += lines_per_job)
+	{
+		struct deinterlace_job *job = &ctx->jobs[ctx->num_jobs++];
+
+		for (i = 0; i < 5; i++)
+			job->src[i] = frames[i] ? frames[i] + plane->offset : NULL;
+		job->dst = dst + plane->offset;
+		job->pitch = plane->pitch;
+		job->bytes = bytes;
+		job->height = height;
+		job->y0 = y;
+		job->y1 = min(y + lines_per_job, height);
+		job->parity = parity;
+	}
+}
+
+void deinterlace_frame(struct thread_pool *pool, const surface_layout_t *layout,
+                       uint8_t *dst, const uint8_t *const frames[5],
+                       uint32_t width, uint32_t height, int bottom_field)
+{
+	unsigned int threads = thread_pool_size(pool);
+	struct deinterlace_ctx ctx = { .num_jobs = 0 };
+	uint32_t chroma_bytes = layout->format == VDP_YCBCR_FORMAT_NV12 ? ALIGN(width, 2) : DIV_ROUND_UP(width, 2);
+	int i;
+
+	deinterlace_add_jobs(&ctx, threads, frames, dst, &layout->plane[0], width, height, bottom_field);
+	for (i = 1; i < layout->num_planes; i++)
+		deinterlace_add_jobs(&ctx, DIV_ROUND_UP(threads, 2), frames, dst, &layout->plane[i],
+		                     chroma_bytes, DIV_ROUND_UP(height, 2), bottom_field);
+
+	thread_pool_run(pool, deinterlace_job_run, &ctx, ctx.num_jobs);
+}
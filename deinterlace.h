@@ -0,0 +1,42 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __DEINTERLACE_H__
+#define __DEINTERLACE_H__
+
+#include "vdpau_private.h"
+
+struct thread_pool;
+
+/*
+ * Motion adaptive deinterlacing of a planar (YV12 or NV12) frame into
+ * dst, which has the same layout. Lines of the shown field are copied
+ * from cur, the others are taken from the neighbouring fields where
+ * nothing moves and interpolated from the lines above and below where
+ * something does.
+ *
+ * frames are prev2, prev, cur, next and next2 as the video mixer gets
+ * them: prev and next hold the other field one field before and after
+ * the shown one, prev2 and next2 the shown field's parity two fields
+ * away and may be NULL. The rows are spread over the pool's threads.
+ */
+void deinterlace_frame(struct thread_pool *pool, const surface_layout_t *layout,
+                       uint8_t *dst, const uint8_t *const frames[5],
+                       uint32_t width, uint32_t height, int bottom_field);
+
+#endif
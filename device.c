@@ -22,6 +22,9 @@
 #include <fcntl.h>
 #include <cedrus/cedrus.h>
 #include "vdpau_private.h"
+#include "thread_pool.h"
+#include "rgba_g2d.h"
+#include "rgba_atlas.h"
 
 VdpStatus vdp_imp_device_create_x11(Display *display,
                                     int screen,
@@ -47,6 +50,11 @@ VdpStatus vdp_imp_device_create_x11(Display *display,
 	}
 
 	VDPAU_DBG("VE version 0x%04x opened", cedrus_get_ve_version(dev->cedrus));
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 1)
+		dev->thread_pool = thread_pool_create(min(cpus - 1, MAX_WORKER_THREADS));
+
 	*get_proc_address = vdp_get_proc_address;
 
 	char *env_vdpau_osd = getenv("VDPAU_OSD");
@@ -81,8 +89,18 @@ VdpStatus vdp_device_destroy(VdpDevice device)
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	VDPAU_DBG("Cache maintenance: %llu bytes by range, %llu whole buffers",
+	          (unsigned long long)cache_flushed_bytes(), (unsigned long long)cache_flushed_buffers());
+
 	if (dev->g2d_enabled)
+	{
+		g2d_close(dev);
 		close(dev->g2d_fd);
+	}
+	atlas_destroy(dev);
+	if (dev->disp)
+		dev->disp->close(dev->disp);
+	thread_pool_destroy(dev->thread_pool);
 	cedrus_close(dev->cedrus);
 	XCloseDisplay(dev->display);
 
@@ -198,6 +216,30 @@ VdpStatus vdp_get_proc_address(VdpDevice device_handle,
 
 		return VDP_STATUS_OK;
 	}
+	else if (function_id == VDP_FUNC_ID_SUNXI_VIDEO_SURFACE_MAP)
+	{
+		*function_pointer = &vdp_sunxi_video_surface_map;
+
+		return VDP_STATUS_OK;
+	}
+	else if (function_id == VDP_FUNC_ID_SUNXI_VIDEO_SURFACE_UNMAP)
+	{
+		*function_pointer = &vdp_sunxi_video_surface_unmap;
+
+		return VDP_STATUS_OK;
+	}
+	else if (function_id == VDP_FUNC_ID_SUNXI_CACHE_STATISTICS)
+	{
+		*function_pointer = &vdp_sunxi_cache_statistics;
+
+		return VDP_STATUS_OK;
+	}
+	else if (function_id == VDP_FUNC_ID_SUNXI_PRESENTATION_QUEUE_STATISTICS)
+	{
+		*function_pointer = &vdp_sunxi_presentation_queue_statistics;
+
+		return VDP_STATUS_OK;
+	}
 
 	return VDP_STATUS_INVALID_FUNC_ID;
 }
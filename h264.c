@@ -676,7 +676,7 @@ static int fill_frame_lists(h264_context_t *c)
 			writel((uint16_t)c->info->field_order_cnt[1], c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(output_p->pic_type << 8, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(c->output->yuv->data), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(c->output->yuv->data) + c->output->luma_size, c->regs + VE_H264_RAM_WRITE_DATA);
+			writel(cedrus_mem_get_bus_addr(c->output->yuv->data) + c->output->layout.plane[1].offset, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(output_p->extra_data), c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(output_p->extra_data) + c->video_extra_data_len, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(0, c->regs + VE_H264_RAM_WRITE_DATA);
@@ -699,7 +699,7 @@ static int fill_frame_lists(h264_context_t *c)
 			writel(frame_list[i]->bottom_pic_order_cnt, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(surface_p->pic_type << 8, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(surface->yuv->data), c->regs + VE_H264_RAM_WRITE_DATA);
-			writel(cedrus_mem_get_bus_addr(surface->yuv->data) + surface->luma_size, c->regs + VE_H264_RAM_WRITE_DATA);
+			writel(cedrus_mem_get_bus_addr(surface->yuv->data) + surface->layout.plane[1].offset, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(surface_p->extra_data), c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(cedrus_mem_get_bus_addr(surface_p->extra_data) + c->video_extra_data_len, c->regs + VE_H264_RAM_WRITE_DATA);
 			writel(0, c->regs + VE_H264_RAM_WRITE_DATA);
@@ -803,8 +803,8 @@ static VdpStatus h264_decode(decoder_ctx_t *decoder,
 	if (cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680)
 	{
 		writel((0x2 << 4), c->regs + 0x0ec);
-		writel(c->output->chroma_size / 2, c->regs + 0x0c4);
-		writel((ALIGN(decoder->width / 2, 16) << 16) | ALIGN(decoder->width, 32), c->regs + 0x0c8);
+		writel(c->output->layout.plane[2].offset - c->output->layout.plane[1].offset, c->regs + 0x0c4);
+		writel((c->output->layout.plane[1].pitch << 16) | c->output->layout.plane[0].pitch, c->regs + 0x0c8);
 	}
 
 	if (!fill_frame_lists(c))
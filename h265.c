@@ -440,7 +440,7 @@ static void write_pic_list(struct h265_private *p)
 			writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 			writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 			writel(cedrus_mem_get_bus_addr(v->yuv->data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-			writel((cedrus_mem_get_bus_addr(v->yuv->data) + v->luma_size) >> 8, p->regs + VE_HEVC_SRAM_DATA);
+			writel((cedrus_mem_get_bus_addr(v->yuv->data) + v->layout.plane[1].offset) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 		}
 	}
 
@@ -452,7 +452,7 @@ static void write_pic_list(struct h265_private *p)
 	writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 	writel(cedrus_mem_get_bus_addr(vp->extra_data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 	writel(cedrus_mem_get_bus_addr(p->output->yuv->data) >> 8, p->regs + VE_HEVC_SRAM_DATA);
-	writel((cedrus_mem_get_bus_addr(p->output->yuv->data) + p->output->luma_size) >> 8, p->regs + VE_HEVC_SRAM_DATA);
+	writel((cedrus_mem_get_bus_addr(p->output->yuv->data) + p->output->layout.plane[1].offset) >> 8, p->regs + VE_HEVC_SRAM_DATA);
 
 	writel(i, p->regs + VE_HEVC_REC_BUF_IDX);
 }
@@ -570,7 +570,7 @@ static void write_entry_point_list(struct h265_private *p)
 		entry_points[i * 4 + 3] = ((y + p->info->row_height_minus1[ty]) << 16) | ((x + p->info->column_width_minus1[tx]) << 0);
 	}
 
-	cedrus_mem_flush_cache(p->entry_points);
+	cache_flush_range(p->entry_points, 0, p->slice.num_entry_point_offsets * 4 * sizeof(uint32_t));
 	writel(cedrus_mem_get_bus_addr(p->entry_points) >> 8, p->regs + VE_HEVC_TILE_LIST_ADDR);
 }
 
@@ -822,8 +822,8 @@ static VdpStatus h265_decode(decoder_ctx_t *decoder,
 
 		writel(0xc0000000, p->regs + VE_EXTRA_OUT_FMT_OFFSET);
 		writel((0x2 << 4), p->regs + 0x0ec);
-		writel(output->chroma_size / 2, p->regs + 0x0c4);
-		writel((ALIGN(decoder->width / 2, 16) << 16) | ALIGN(decoder->width, 32), p->regs + 0x0c8);
+		writel(output->layout.plane[2].offset - output->layout.plane[1].offset, p->regs + 0x0c4);
+		writel((output->layout.plane[1].pitch << 16) | output->layout.plane[0].pitch, p->regs + 0x0c8);
 		writel(0x00000000, p->regs + 0x0cc);
 		writel(0x00000000, p->regs + 0x550);
 		writel(0x00000000, p->regs + 0x554);
@@ -181,18 +181,18 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 
 		// set output buffers
 		writel(cedrus_mem_get_bus_addr(output->yuv->data), ve_regs + VE_MPEG_REC_LUMA);
-		writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->luma_size, ve_regs + VE_MPEG_REC_CHROMA);
+		writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->layout.plane[1].offset, ve_regs + VE_MPEG_REC_CHROMA);
 		writel(cedrus_mem_get_bus_addr(output->yuv->data), ve_regs + VE_MPEG_ROT_LUMA);
-		writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->luma_size, ve_regs + VE_MPEG_ROT_CHROMA);
+		writel(cedrus_mem_get_bus_addr(output->yuv->data) + output->layout.plane[1].offset, ve_regs + VE_MPEG_ROT_CHROMA);
 
 		// ??
 		writel(0x40620000, ve_regs + VE_MPEG_SDROT_CTRL);
 		if (cedrus_get_ve_version(decoder->device->cedrus) >= 0x1680)
 		{
-			writel((0x2 << 30) | (0x1 << 28) | (output->chroma_size / 2), ve_regs + VE_EXTRA_OUT_FMT_OFFSET);
+			writel((0x2 << 30) | (0x1 << 28) | (output->layout.plane[2].offset - output->layout.plane[1].offset), ve_regs + VE_EXTRA_OUT_FMT_OFFSET);
 			writel((0x2 << 4), ve_regs + 0x0ec);
-			writel(output->chroma_size / 2, ve_regs + 0x0c4);
-			writel((ALIGN(decoder->width / 2, 16) << 16) | ALIGN(decoder->width, 32), ve_regs + 0x0c8);
+			writel(output->layout.plane[2].offset - output->layout.plane[1].offset, ve_regs + 0x0c4);
+			writel((output->layout.plane[1].pitch << 16) | output->layout.plane[0].pitch, ve_regs + 0x0c8);
 		}
 
 		// set vop header
@@ -229,13 +229,13 @@ static VdpStatus mpeg4_decode(decoder_ctx_t *decoder,
 		{
 			video_surface_ctx_t *forward = handle_get(info->forward_reference);
 			writel(cedrus_mem_get_bus_addr(forward->yuv->data), ve_regs + VE_MPEG_FWD_LUMA);
-			writel(cedrus_mem_get_bus_addr(forward->yuv->data) + forward->luma_size, ve_regs + VE_MPEG_FWD_CHROMA);
+			writel(cedrus_mem_get_bus_addr(forward->yuv->data) + forward->layout.plane[1].offset, ve_regs + VE_MPEG_FWD_CHROMA);
 		}
 		if (info->backward_reference != VDP_INVALID_HANDLE)
 		{
 			video_surface_ctx_t *backward = handle_get(info->backward_reference);
 			writel(cedrus_mem_get_bus_addr(backward->yuv->data), ve_regs + VE_MPEG_BACK_LUMA);
-			writel(cedrus_mem_get_bus_addr(backward->yuv->data) + backward->luma_size, ve_regs + VE_MPEG_BACK_CHROMA);
+			writel(cedrus_mem_get_bus_addr(backward->yuv->data) + backward->layout.plane[1].offset, ve_regs + VE_MPEG_BACK_CHROMA);
 		}
 
 		// set trb/trd
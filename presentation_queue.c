@@ -37,6 +37,277 @@ static uint64_t get_time(void)
 	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
 }
 
+/*
+ * The root relative position changes when the drawable or any of its
+ * ancestors gets moved or reparented, so watch all of them on the
+ * driver's own connection.
+ */
+static void select_ancestors(Display *display, Window window)
+{
+	Window root, parent, *children;
+	unsigned int num_children;
+
+	while (XQueryTree(display, window, &root, &parent, &children, &num_children))
+	{
+		if (children)
+			XFree(children);
+
+		XSelectInput(display, window, StructureNotifyMask);
+		if (parent == root || parent == None)
+			break;
+
+		window = parent;
+	}
+}
+
+// only talks to the X server if some window geometry changed
+static void update_geometry(queue_target_ctx_t *qt, device_ctx_t *dev)
+{
+	while (XPending(dev->display))
+	{
+		XEvent event;
+		XNextEvent(dev->display, &event);
+		if (event.type == ConfigureNotify || event.type == ReparentNotify)
+			dev->geometry_serial++;
+	}
+
+	if (qt->geometry_serial == dev->geometry_serial)
+		return;
+
+	select_ancestors(dev->display, qt->drawable);
+
+	Window c;
+	XTranslateCoordinates(dev->display, qt->drawable, RootWindow(dev->display, dev->screen), 0, 0, &qt->x, &qt->y, &c);
+	XClearWindow(dev->display, qt->drawable);
+
+	qt->geometry_serial = dev->geometry_serial;
+}
+
+static void show_entry(queue_ctx_t *q, const queue_entry_t *entry)
+{
+	output_surface_ctx_t *os = entry->surface;
+	int i;
+
+	if (os->yuv)
+		q->target->disp->set_video_layer(q->target->disp, entry->x, entry->y, entry->clip_width, entry->clip_height, os);
+	else
+		q->target->disp->close_video_layer(q->target->disp);
+
+	if (q->device->osd_enabled)
+	{
+		if (entry->show_osd)
+			q->target->disp->set_osd_layer(q->target->disp, entry->x, entry->y, entry->clip_width, entry->clip_height, os);
+		else
+			q->target->disp->close_osd_layer(q->target->disp);
+
+		for (i = 0; i < q->target->disp->num_extra_layers; i++)
+		{
+			if (entry->layers[i])
+				q->target->disp->set_extra_layer(q->target->disp, i, entry->x, entry->y, entry->clip_width, entry->clip_height, entry->layers[i]);
+			else
+				q->target->disp->close_extra_layer(q->target->disp, i);
+		}
+	}
+
+	if (q->target->disp->commit)
+		q->target->disp->commit(q->target->disp);
+}
+
+/*
+ * Waits for the next vblank and keeps a running estimate of the frame
+ * period. Returns when layers programmed now become visible, 0
+ * without vsync.
+ */
+static VdpTime wait_for_vsync(queue_ctx_t *q)
+{
+	uint64_t timestamp;
+
+	if (!q->target->disp->wait_for_vsync || q->target->disp->wait_for_vsync(q->target->disp, &timestamp) != 0)
+		return 0;
+
+	VdpTime interval = timestamp - q->last_vsync;
+	if (!q->vsync_period && q->last_vsync)
+		q->vsync_period = interval;
+	else if (interval > q->vsync_period / 2 && interval < q->vsync_period * 3 / 2)
+		q->vsync_period = q->vsync_period + interval / 8 - q->vsync_period / 8;
+	q->last_vsync = timestamp;
+
+	return timestamp + q->vsync_period;
+}
+
+static void update_stats(queue_ctx_t *q, VdpTime earliest, VdpTime presented)
+{
+	q->stats.frames++;
+
+	if (earliest && presented > earliest)
+	{
+		uint64_t lateness = presented - earliest;
+		q->stats.lateness_sum += lateness;
+		if (lateness > q->stats.lateness_max)
+			q->stats.lateness_max = lateness;
+		if (q->vsync_period && lateness >= q->vsync_period)
+			q->stats.late++;
+	}
+
+	// deviation of the frame interval from a whole number of vsyncs
+	if (q->vsync_period && q->stats.last_presentation_time)
+	{
+		uint64_t error = (presented - q->stats.last_presentation_time) % q->vsync_period;
+		q->stats.interval_error_sum += min(error, q->vsync_period - error);
+	}
+	q->stats.last_presentation_time = presented;
+}
+
+// with the mutex held or the flip thread stopped
+static void get_stats(queue_ctx_t *q, VdpSunxiPresentationQueueStats *stats)
+{
+	stats->frames = q->stats.frames;
+	stats->late = q->stats.late;
+	stats->vsync_period = q->vsync_period;
+	stats->lateness_avg = q->stats.frames ? q->stats.lateness_sum / q->stats.frames : 0;
+	stats->lateness_max = q->stats.lateness_max;
+	stats->jitter_avg = q->stats.frames ? q->stats.interval_error_sum / q->stats.frames : 0;
+}
+
+/*
+ * Replaces the layers on screen. The replaced ones are left for the
+ * queueing thread to drop, freeing them here would race with it.
+ */
+static void retire_layers(queue_ctx_t *q, mixer_layer_t *const *layers)
+{
+	int i;
+
+	for (i = 0; i < SUNXI_DISP_MAX_EXTRA_LAYERS; i++)
+	{
+		if (q->visible_layers[i])
+			q->retired_layers[q->num_retired_layers++] = q->visible_layers[i];
+		q->visible_layers[i] = layers[i];
+	}
+}
+
+// takes the retired layers with the mutex held, to drop them after unlocking
+static unsigned int take_retired_layers(queue_ctx_t *q, mixer_layer_t **layers)
+{
+	unsigned int count = q->num_retired_layers;
+
+	memcpy(layers, q->retired_layers, count * sizeof(*layers));
+	q->num_retired_layers = 0;
+
+	return count;
+}
+
+static void unref_layers(mixer_layer_t *const *layers, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		if (layers[i])
+			mixer_layer_unref(layers[i]);
+}
+
+/*
+ * Shows queued surfaces in order, each not before its earliest
+ * presentation time. With vsync the layers get reprogrammed right
+ * after the vblank preceding the target, and are visible one period
+ * later. Only the display ioctls happen here, everything touching X
+ * or the surface contents is done by the queueing thread.
+ */
+static void *flip_thread(void *arg)
+{
+	queue_ctx_t *q = arg;
+
+	// two vblanks for an initial period estimate
+	if (wait_for_vsync(q))
+		wait_for_vsync(q);
+
+	pthread_mutex_lock(&q->mutex);
+	while (!q->quit)
+	{
+		if (q->count == 0)
+		{
+			pthread_cond_wait(&q->queued, &q->mutex);
+			continue;
+		}
+
+		queue_entry_t entry = q->entries[q->head];
+		VdpTime wakeup = entry.earliest_presentation_time - min(entry.earliest_presentation_time, 2 * q->vsync_period);
+		if (wakeup > get_time())
+		{
+			struct timespec ts = { wakeup / 1000000000ULL, wakeup % 1000000000ULL };
+			pthread_cond_timedwait(&q->queued, &q->mutex, &ts);
+			continue;
+		}
+
+		q->head = (q->head + 1) % PRESENTATION_QUEUE_LENGTH;
+		q->count--;
+		q->flipping = entry.surface;
+		pthread_mutex_unlock(&q->mutex);
+
+		// latch right after the vblank that makes it visible closest to the target
+		VdpTime now = wait_for_vsync(q);
+		while (now && now + q->vsync_period / 2 <= entry.earliest_presentation_time)
+			now = wait_for_vsync(q);
+
+		show_entry(q, &entry);
+		if (!now)
+			now = get_time();
+
+		pthread_mutex_lock(&q->mutex);
+		update_stats(q, entry.earliest_presentation_time, now);
+		retire_layers(q, entry.layers);
+		if (q->visible && q->visible != entry.surface)
+			q->visible->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+		entry.surface->status = VDP_PRESENTATION_QUEUE_STATUS_VISIBLE;
+		entry.surface->first_presentation_time = now;
+		q->visible = entry.surface;
+		q->flipping = NULL;
+		pthread_cond_broadcast(&q->flipped);
+	}
+	pthread_mutex_unlock(&q->mutex);
+
+	return NULL;
+}
+
+// drops a surface about to be destroyed from its queue
+void presentation_queue_release_surface(output_surface_ctx_t *surface)
+{
+	queue_ctx_t *q = surface->queue;
+	mixer_layer_t *layers[PRESENTATION_QUEUE_LENGTH * SUNXI_DISP_MAX_EXTRA_LAYERS];
+	unsigned int i, count = 0, num_layers = 0;
+
+	if (!q)
+		return;
+
+	pthread_mutex_lock(&q->mutex);
+	while (q->flipping == surface)
+		pthread_cond_wait(&q->flipped, &q->mutex);
+
+	for (i = 0; i < q->count; i++)
+	{
+		queue_entry_t *entry = &q->entries[(q->head + i) % PRESENTATION_QUEUE_LENGTH];
+		if (entry->surface != surface)
+		{
+			q->entries[(q->head + count++) % PRESENTATION_QUEUE_LENGTH] = *entry;
+		}
+		else
+		{
+			memcpy(layers + num_layers, entry->layers, sizeof(entry->layers));
+			num_layers += SUNXI_DISP_MAX_EXTRA_LAYERS;
+		}
+	}
+	q->count = count;
+
+	if (q->visible == surface)
+		q->visible = NULL;
+
+	surface->queue = NULL;
+	surface->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+	pthread_cond_broadcast(&q->flipped);
+	pthread_mutex_unlock(&q->mutex);
+
+	unref_layers(layers, num_layers);
+}
+
 VdpStatus vdp_presentation_queue_target_create_x11(VdpDevice device,
                                                    Drawable drawable,
                                                    VdpPresentationQueueTarget *target)
@@ -53,18 +324,30 @@ VdpStatus vdp_presentation_queue_target_create_x11(VdpDevice device,
 		return VDP_STATUS_RESOURCES;
 
 	qt->drawable = drawable;
+	qt->geometry_serial = dev->geometry_serial - 1;
 	XSetWindowBackground(dev->display, drawable, 0x000102);
 
-	qt->disp = sunxi_disp_open(dev->osd_enabled);
+	if (!dev->disp)
+		dev->disp = sunxi_disp_probe(dev->osd_enabled);
 
-	if (!qt->disp)
-		qt->disp = sunxi_disp2_open(dev->osd_enabled);
+	if (!dev->disp)
+	{
+		handle_destroy(*target);
+		return VDP_STATUS_ERROR;
+	}
 
+	qt->disp = dev->disp->open_target(dev->disp);
 	if (!qt->disp)
-		qt->disp = sunxi_disp1_5_open(dev->osd_enabled);
+	{
+		handle_destroy(*target);
+		return VDP_STATUS_RESOURCES;
+	}
 
-	if (!qt->disp)
-		return VDP_STATUS_ERROR;
+	// the mixer only uses extra layers every target has
+	if (dev->disp->num_targets++ == 0 || qt->disp->num_extra_layers < dev->disp->extra_layers)
+		dev->disp->extra_layers = qt->disp->num_extra_layers;
+
+	qt->device = dev;
 
 	return VDP_STATUS_OK;
 }
@@ -76,6 +359,7 @@ VdpStatus vdp_presentation_queue_target_destroy(VdpPresentationQueueTarget prese
 		return VDP_STATUS_INVALID_HANDLE;
 
 	qt->disp->close(qt->disp);
+	qt->device->disp->num_targets--;
 
 	handle_destroy(presentation_queue_target);
 
@@ -104,6 +388,23 @@ VdpStatus vdp_presentation_queue_create(VdpDevice device,
 	q->target = qt;
 	q->device = dev;
 
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->queued, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&q->flipped, NULL);
+	pthread_mutex_init(&q->mutex, NULL);
+
+	if (pthread_create(&q->flip_thread, NULL, flip_thread, q) != 0)
+	{
+		pthread_mutex_destroy(&q->mutex);
+		pthread_cond_destroy(&q->flipped);
+		pthread_cond_destroy(&q->queued);
+		handle_destroy(*presentation_queue);
+		return VDP_STATUS_RESOURCES;
+	}
+
 	return VDP_STATUS_OK;
 }
 
@@ -113,6 +414,46 @@ VdpStatus vdp_presentation_queue_destroy(VdpPresentationQueue presentation_queue
 	if (!q)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	pthread_mutex_lock(&q->mutex);
+	q->quit = 1;
+	pthread_cond_signal(&q->queued);
+	pthread_mutex_unlock(&q->mutex);
+	pthread_join(q->flip_thread, NULL);
+
+	VdpSunxiPresentationQueueStats stats;
+	get_stats(q, &stats);
+	if (stats.frames)
+		VDPAU_DBG("%u frames, vsync period %llu us, %u late by a vsync or more, lateness avg %llu us max %llu us, interval jitter avg %llu us",
+		          stats.frames, (unsigned long long)stats.vsync_period / 1000, stats.late,
+		          (unsigned long long)stats.lateness_avg / 1000, (unsigned long long)stats.lateness_max / 1000,
+		          (unsigned long long)stats.jitter_avg / 1000);
+
+	// surfaces outliving the queue must not reference it
+	for (; q->count > 0; q->count--, q->head = (q->head + 1) % PRESENTATION_QUEUE_LENGTH)
+	{
+		q->entries[q->head].surface->queue = NULL;
+		q->entries[q->head].surface->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+		unref_layers(q->entries[q->head].layers, SUNXI_DISP_MAX_EXTRA_LAYERS);
+	}
+
+	// the display has to let go of the layers before they get freed
+	int i;
+	for (i = 0; i < q->target->disp->num_extra_layers; i++)
+		q->target->disp->close_extra_layer(q->target->disp, i);
+	if (q->target->disp->commit)
+		q->target->disp->commit(q->target->disp);
+	unref_layers(q->visible_layers, SUNXI_DISP_MAX_EXTRA_LAYERS);
+	unref_layers(q->retired_layers, q->num_retired_layers);
+	if (q->visible)
+	{
+		q->visible->queue = NULL;
+		q->visible->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+	}
+
+	pthread_mutex_destroy(&q->mutex);
+	pthread_cond_destroy(&q->flipped);
+	pthread_cond_destroy(&q->queued);
+
 	handle_destroy(presentation_queue);
 
 	return VDP_STATUS_OK;
@@ -179,36 +520,58 @@ VdpStatus vdp_presentation_queue_display(VdpPresentationQueue presentation_queue
 	if (!os)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	if (earliest_presentation_time != 0)
-		VDPAU_DBG_ONCE("Presentation time not supported");
+	update_geometry(q->target, q->device);
 
-	Window c;
-	int x,y;
-	XTranslateCoordinates(q->device->display, q->target->drawable, RootWindow(q->device->display, q->device->screen), 0, 0, &x, &y, &c);
-	XClearWindow(q->device->display, q->target->drawable);
+	queue_entry_t entry = { os, earliest_presentation_time, q->target->x, q->target->y, clip_width, clip_height, 0 };
 
-	if (os->vs)
-		q->target->disp->set_video_layer(q->target->disp, x, y, clip_width, clip_height, os);
-	else
-		q->target->disp->close_video_layer(q->target->disp);
+	if (q->device->osd_enabled)
+	{
+		if (os->rgba.flags & RGBA_FLAG_NEEDS_CLEAR)
+			rgba_clear(&os->rgba);
+
+		if (os->rgba.flags & RGBA_FLAG_DIRTY)
+		{
+			rgba_flush(&os->rgba);
+			rgba_sync(&os->rgba);
+			entry.show_osd = 1;
+		}
+
+		int i;
+		for (i = 0; i < SUNXI_DISP_MAX_EXTRA_LAYERS; i++)
+		{
+			if (!os->layers[i])
+				continue;
+
+			rgba_flush(&os->layers[i]->rgba);
+			rgba_sync(&os->layers[i]->rgba);
+			entry.layers[i] = mixer_layer_ref(os->layers[i]);
+		}
+	}
 
-	if (!q->device->osd_enabled)
-		return VDP_STATUS_OK;
+	mixer_layer_t *retired[ARRAY_SIZE(q->retired_layers)];
+	unsigned int num_retired;
 
-	if (os->rgba.flags & RGBA_FLAG_NEEDS_CLEAR)
-		rgba_clear(&os->rgba);
+	pthread_mutex_lock(&q->mutex);
+	while (q->count == PRESENTATION_QUEUE_LENGTH)
+		pthread_cond_wait(&q->flipped, &q->mutex);
 
-	if (os->rgba.flags & RGBA_FLAG_DIRTY)
+	// a surface can only be in one queue at a time
+	if (os->queue && os->queue != q)
 	{
-		rgba_flush(&os->rgba);
-
-		q->target->disp->set_osd_layer(q->target->disp, x, y, clip_width, clip_height, os);
-	}
-	else
-	{
-		q->target->disp->close_osd_layer(q->target->disp);
+		pthread_mutex_unlock(&q->mutex);
+		presentation_queue_release_surface(os);
+		pthread_mutex_lock(&q->mutex);
 	}
 
+	q->entries[(q->head + q->count++) % PRESENTATION_QUEUE_LENGTH] = entry;
+	os->queue = q;
+	os->status = VDP_PRESENTATION_QUEUE_STATUS_QUEUED;
+	pthread_cond_signal(&q->queued);
+	num_retired = take_retired_layers(q, retired);
+	pthread_mutex_unlock(&q->mutex);
+
+	unref_layers(retired, num_retired);
+
 	return VDP_STATUS_OK;
 }
 
@@ -224,7 +587,14 @@ VdpStatus vdp_presentation_queue_block_until_surface_idle(VdpPresentationQueue p
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*first_presentation_time = get_time();
+	if (q->device->osd_enabled)
+		rgba_sync(&out->rgba);
+
+	pthread_mutex_lock(&q->mutex);
+	while (out->queue == q && out->status != VDP_PRESENTATION_QUEUE_STATUS_IDLE)
+		pthread_cond_wait(&q->flipped, &q->mutex);
+	*first_presentation_time = out->first_presentation_time;
+	pthread_mutex_unlock(&q->mutex);
 
 	return VDP_STATUS_OK;
 }
@@ -242,8 +612,27 @@ VdpStatus vdp_presentation_queue_query_surface_status(VdpPresentationQueue prese
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*status = VDP_PRESENTATION_QUEUE_STATUS_VISIBLE;
-	*first_presentation_time = get_time();
+	pthread_mutex_lock(&q->mutex);
+	*status = out->queue == q ? out->status : VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+	*first_presentation_time = out->first_presentation_time;
+	pthread_mutex_unlock(&q->mutex);
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_sunxi_presentation_queue_statistics(VdpPresentationQueue presentation_queue,
+                                                  VdpSunxiPresentationQueueStats *stats)
+{
+	queue_ctx_t *q = handle_get(presentation_queue);
+	if (!q)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (!stats)
+		return VDP_STATUS_INVALID_POINTER;
+
+	pthread_mutex_lock(&q->mutex);
+	get_stats(q, stats);
+	pthread_mutex_unlock(&q->mutex);
 
 	return VDP_STATUS_OK;
 }
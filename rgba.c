@@ -24,26 +24,105 @@
 #include "rgba.h"
 #include "rgba_pixman.h"
 #include "rgba_g2d.h"
+#include "rgba_atlas.h"
+#include "yuv_convert.h"
 
-static void dirty_add_rect(VdpRect *dirty, const VdpRect *rect)
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+static void rect_union(VdpRect *res, const VdpRect *a, const VdpRect *b)
+{
+	res->x0 = min(a->x0, b->x0);
+	res->y0 = min(a->y0, b->y0);
+	res->x1 = max(a->x1, b->x1);
+	res->y1 = max(a->y1, b->y1);
+}
+
+static int rect_in_rect(const VdpRect *inner, const VdpRect *outer)
+{
+	return (inner->x0 >= outer->x0) && (inner->y0 >= outer->y0) &&
+	       (inner->x1 <= outer->x1) && (inner->y1 <= outer->y1);
+}
+
+static uint32_t rect_area(const VdpRect *rect)
 {
-	dirty->x0 = min(dirty->x0, rect->x0);
-	dirty->y0 = min(dirty->y0, rect->y0);
-	dirty->x1 = max(dirty->x1, rect->x1);
-	dirty->y1 = max(dirty->y1, rect->y1);
+	return (rect->x1 - rect->x0) * (rect->y1 - rect->y0);
 }
 
-static int dirty_in_rect(const VdpRect *dirty, const VdpRect *rect)
+static void region_clear(rgba_region_t *region)
+{
+	region->num_rects = 0;
+	region->bounds.x0 = region->bounds.y0 = 0;
+	region->bounds.x1 = region->bounds.y1 = 0;
+}
+
+static int region_in_rect(const rgba_region_t *region, const VdpRect *rect)
+{
+	return region->num_rects == 0 || rect_in_rect(&region->bounds, rect);
+}
+
+/*
+ * Adds a rectangle, if the region is full the two rectangles whose union
+ * grows the covered area least get merged.
+ */
+static void region_add_rect(rgba_region_t *region, const VdpRect *rect)
 {
-	return (dirty->x0 >= rect->x0) && (dirty->y0 >= rect->y0) &&
-	       (dirty->x1 <= rect->x1) && (dirty->y1 <= rect->y1);
+	VdpRect rects[RGBA_MAX_RECTS + 1];
+	int i, j, num = 0;
+
+	if (rect->x0 >= rect->x1 || rect->y0 >= rect->y1)
+		return;
+
+	for (i = 0; i < region->num_rects; i++)
+	{
+		if (rect_in_rect(rect, &region->rects[i]))
+			return;
+
+		if (!rect_in_rect(&region->rects[i], rect))
+			rects[num++] = region->rects[i];
+	}
+	rects[num++] = *rect;
+
+	while (num > RGBA_MAX_RECTS)
+	{
+		int best_i = 0, best_j = 1;
+		int64_t best_growth = INT64_MAX;
+
+		for (i = 0; i < num; i++)
+			for (j = i + 1; j < num; j++)
+			{
+				VdpRect u;
+				rect_union(&u, &rects[i], &rects[j]);
+				int64_t growth = (int64_t)rect_area(&u) - rect_area(&rects[i]) - rect_area(&rects[j]);
+				if (growth < best_growth)
+				{
+					best_growth = growth;
+					best_i = i;
+					best_j = j;
+				}
+			}
+
+		rect_union(&rects[best_i], &rects[best_i], &rects[best_j]);
+		rects[best_j] = rects[--num];
+	}
+
+	if (region->num_rects == 0)
+		region->bounds = *rect;
+	else
+		rect_union(&region->bounds, &region->bounds, rect);
+
+	memcpy(region->rects, rects, num * sizeof(VdpRect));
+	region->num_rects = num;
 }
 
 VdpStatus rgba_create(rgba_surface_t *rgba,
                       device_ctx_t *device,
                       uint32_t width,
                       uint32_t height,
-                      VdpRGBAFormat format)
+                      VdpRGBAFormat format,
+                      int scanout)
 {
 	if (format != VDP_RGBA_FORMAT_B8G8R8A8 && format != VDP_RGBA_FORMAT_R8G8B8A8)
 		return VDP_STATUS_INVALID_RGBA_FORMAT;
@@ -55,34 +134,87 @@ VdpStatus rgba_create(rgba_surface_t *rgba,
 	rgba->width = width;
 	rgba->height = height;
 	rgba->format = format;
+	rgba->data = NULL;
+	rgba->pixels = NULL;
+
+	// only surfaces the hardware touches need contiguous memory
+	if (!scanout && !device->g2d_enabled)
+		rgba->flags |= RGBA_FLAG_HEAP;
+	else if (!scanout && width * height * 4 <= ATLAS_MAX_SURFACE_SIZE)
+		rgba->flags |= RGBA_FLAG_ATLAS;
+
+	return VDP_STATUS_OK;
+}
 
-	if (device->osd_enabled)
+/*
+ * Pixels get allocated on first use, heap memory comes zeroed
+ * and only contiguous memory needs an initial clear.
+ */
+static VdpStatus rgba_alloc(rgba_surface_t *rgba)
+{
+	if (rgba->pixels)
+		return VDP_STATUS_OK;
+
+	if (rgba->flags & RGBA_FLAG_HEAP)
+	{
+		rgba->pixels = calloc(rgba->width * rgba->height, 4);
+		if (!rgba->pixels)
+			return VDP_STATUS_RESOURCES;
+	}
+	else
 	{
-		rgba->data = cedrus_mem_alloc(device->cedrus, width * height * 4);
+		if (rgba->flags & RGBA_FLAG_ATLAS)
+			rgba->data = atlas_alloc(rgba->device, rgba->width * rgba->height * 4, &rgba->offset);
+		else
+			rgba->data = cedrus_mem_alloc(rgba->device->cedrus, rgba->width * rgba->height * 4);
 		if (!rgba->data)
 			return VDP_STATUS_RESOURCES;
+		rgba->pixels = cedrus_mem_get_pointer(rgba->data) + rgba->offset;
+	}
 
-		if(!device->g2d_enabled)
-			vdp_pixman_ref(rgba);
+	if(!rgba->device->g2d_enabled)
+		vdp_pixman_ref(rgba);
 
-		rgba->dirty.x0 = width;
-		rgba->dirty.y0 = height;
-		rgba->dirty.x1 = 0;
-		rgba->dirty.y1 = 0;
+	region_clear(&rgba->dirty);
+	region_clear(&rgba->unflushed);
+	if (rgba->data)
 		rgba_fill(rgba, NULL, 0x00000000);
-	}
 
 	return VDP_STATUS_OK;
 }
 
 void rgba_destroy(rgba_surface_t *rgba)
 {
-	if (rgba->device->osd_enabled)
+	if (rgba->device->osd_enabled && rgba->pixels)
 	{
+		// queued G2D commands might still reference it
+		rgba_sync(rgba);
+
 		if(!rgba->device->g2d_enabled)
 			vdp_pixman_unref(rgba);
 
-		cedrus_mem_free(rgba->data);
+		if (rgba->flags & RGBA_FLAG_ATLAS)
+			atlas_free(rgba->device, rgba->data, rgba->offset, rgba->width * rgba->height * 4);
+		else if (rgba->data)
+			cedrus_mem_free(rgba->data);
+		else
+			free(rgba->pixels);
+	}
+}
+
+/*
+ * Wait for queued G2D commands before the CPU touches the lines of
+ * rect, and drop cache lines that are stale since G2D wrote to them.
+ */
+static void begin_cpu_access(rgba_surface_t *rgba, const VdpRect *rect)
+{
+	rgba_sync(rgba);
+
+	if (rgba->flags & RGBA_FLAG_NEEDS_INVALIDATE)
+	{
+		int whole = cache_flush_range(rgba->data, rgba->offset + rect->y0 * rgba->width * 4, (rect->y1 - rect->y0) * rgba->width * 4);
+		if (whole || (rect->y0 == 0 && rect->y1 == rgba->height))
+			rgba->flags &= ~RGBA_FLAG_NEEDS_INVALIDATE;
 	}
 }
 
@@ -94,24 +226,29 @@ VdpStatus rgba_put_bits_native(rgba_surface_t *rgba,
 	if (!rgba->device->osd_enabled)
 		return VDP_STATUS_OK;
 
+	if (rgba_alloc(rgba) != VDP_STATUS_OK)
+		return VDP_STATUS_RESOURCES;
+
 	VdpRect d_rect = {0, 0, rgba->width, rgba->height};
 	if (destination_rect)
 		d_rect = *destination_rect;
 
-	if ((rgba->flags & RGBA_FLAG_NEEDS_CLEAR) && !dirty_in_rect(&rgba->dirty, &d_rect))
+	if ((rgba->flags & RGBA_FLAG_NEEDS_CLEAR) && !region_in_rect(&rgba->dirty, &d_rect))
 		rgba_clear(rgba);
 
+	begin_cpu_access(rgba, &d_rect);
+
 	if (0 == d_rect.x0 && rgba->width == d_rect.x1 && source_pitches[0] == d_rect.x1 * 4) {
 		// full width
 		const int bytes_to_copy =
 			(d_rect.x1 - d_rect.x0) * (d_rect.y1 - d_rect.y0) * 4;
-		memcpy(cedrus_mem_get_pointer(rgba->data) + d_rect.y0 * rgba->width * 4,
+		memcpy(rgba->pixels + d_rect.y0 * rgba->width * 4,
 			   source_data[0], bytes_to_copy);
 	} else {
 		const unsigned int bytes_in_line = (d_rect.x1-d_rect.x0) * 4;
 		unsigned int y;
 		for (y = d_rect.y0; y < d_rect.y1; y ++) {
-			memcpy(cedrus_mem_get_pointer(rgba->data) + (y * rgba->width + d_rect.x0) * 4,
+			memcpy(rgba->pixels + (y * rgba->width + d_rect.x0) * 4,
 				   source_data[0] + (y - d_rect.y0) * source_pitches[0],
 				   bytes_in_line);
 		}
@@ -119,11 +256,168 @@ VdpStatus rgba_put_bits_native(rgba_surface_t *rgba,
 
 	rgba->flags &= ~RGBA_FLAG_NEEDS_CLEAR;
 	rgba->flags |= RGBA_FLAG_DIRTY | RGBA_FLAG_NEEDS_FLUSH;
-	dirty_add_rect(&rgba->dirty, &d_rect);
+	region_add_rect(&rgba->dirty, &d_rect);
+	region_add_rect(&rgba->unflushed, &d_rect);
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus rgba_get_bits_native(rgba_surface_t *rgba,
+                               VdpRect const *source_rect,
+                               void *const *destination_data,
+                               uint32_t const *destination_pitches)
+{
+	if (!rgba->device->osd_enabled)
+		return VDP_STATUS_ERROR;
+
+	if (rgba_alloc(rgba) != VDP_STATUS_OK)
+		return VDP_STATUS_RESOURCES;
+
+	VdpRect s_rect = {0, 0, rgba->width, rgba->height};
+	if (source_rect)
+	{
+		s_rect.x0 = min(source_rect->x0, rgba->width);
+		s_rect.y0 = min(source_rect->y0, rgba->height);
+		s_rect.x1 = min(source_rect->x1, rgba->width);
+		s_rect.y1 = min(source_rect->y1, rgba->height);
+	}
+
+	if (s_rect.x0 >= s_rect.x1 || s_rect.y0 >= s_rect.y1)
+		return VDP_STATUS_OK;
+
+	if (rgba->flags & RGBA_FLAG_NEEDS_CLEAR)
+		rgba_clear(rgba);
+
+	begin_cpu_access(rgba, &s_rect);
+
+	const uint8_t *src = rgba->pixels + (s_rect.y0 * rgba->width + s_rect.x0) * 4;
+	uint8_t *dst = destination_data[0];
+	const unsigned int bytes_in_line = (s_rect.x1 - s_rect.x0) * 4;
+
+	if (bytes_in_line == rgba->width * 4 && destination_pitches[0] == bytes_in_line)
+	{
+		memcpy(dst, src, bytes_in_line * (s_rect.y1 - s_rect.y0));
+	}
+	else
+	{
+		unsigned int y;
+		for (y = s_rect.y0; y < s_rect.y1; y++)
+		{
+			memcpy(dst, src, bytes_in_line);
+			src += rgba->width * 4;
+			dst += destination_pitches[0];
+		}
+	}
 
 	return VDP_STATUS_OK;
 }
 
+/*
+ * Palette converted to the surface byte order once per call, with zero
+ * alpha. The 4-bit formats also get per-channel tables for NEON lookups.
+ */
+struct palette
+{
+	uint32_t color[256];
+#ifdef HAVE_NEON
+	uint8_t channel[3][16];
+#endif
+};
+
+static void palette_init(struct palette *pal, const uint32_t *color_table,
+                         int num_colors, VdpRGBAFormat format)
+{
+	int i;
+
+	for (i = 0; i < num_colors; i++)
+	{
+		uint32_t c = color_table[i] & 0x00ffffff;
+		if (format == VDP_RGBA_FORMAT_R8G8B8A8)
+			c = ((c & 0xff) << 16) | (c & 0xff00) | ((c >> 16) & 0xff);
+		pal->color[i] = c;
+	}
+
+#ifdef HAVE_NEON
+	if (num_colors == 16)
+		for (i = 0; i < 16; i++)
+		{
+			pal->channel[0][i] = pal->color[i];
+			pal->channel[1][i] = pal->color[i] >> 8;
+			pal->channel[2][i] = pal->color[i] >> 16;
+		}
+#endif
+}
+
+static void expand_i8a8_row(uint32_t *dst, const uint8_t *src, const struct palette *pal, unsigned int n)
+{
+	unsigned int x;
+
+	for (x = 0; x < n; x++)
+		dst[x] = pal->color[src[x * 2]] | (src[x * 2 + 1] << 24);
+}
+
+static void expand_a8i8_row(uint32_t *dst, const uint8_t *src, const struct palette *pal, unsigned int n)
+{
+	unsigned int x;
+
+	for (x = 0; x < n; x++)
+		dst[x] = pal->color[src[x * 2 + 1]] | (src[x * 2] << 24);
+}
+
+#ifdef HAVE_NEON
+static uint8x16_t lookup16(const uint8_t *table, uint8x16_t idx)
+{
+#ifdef __aarch64__
+	return vqtbl1q_u8(vld1q_u8(table), idx);
+#else
+	uint8x8x2_t t;
+	t.val[0] = vld1_u8(table);
+	t.val[1] = vld1_u8(table + 8);
+	return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+#endif
+}
+#endif
+
+// 4-bit index and 4-bit alpha, index_shift selects which nibble is the index
+static void expand_4bit_row(uint32_t *dst, const uint8_t *src, const struct palette *pal,
+                            unsigned int n, int index_shift)
+{
+	const int alpha_shift = 4 - index_shift;
+	unsigned int x = 0;
+
+#ifdef HAVE_NEON
+	const uint8x16_t mask = vdupq_n_u8(0x0f);
+	for (; x + 16 <= n; x += 16)
+	{
+		uint8x16_t v = vld1q_u8(src + x);
+		uint8x16_t i, a;
+		if (index_shift)
+		{
+			i = vshrq_n_u8(v, 4);
+			a = vandq_u8(v, mask);
+		}
+		else
+		{
+			i = vandq_u8(v, mask);
+			a = vshrq_n_u8(v, 4);
+		}
+
+		uint8x16x4_t out;
+		out.val[0] = lookup16(pal->channel[0], i);
+		out.val[1] = lookup16(pal->channel[1], i);
+		out.val[2] = lookup16(pal->channel[2], i);
+		out.val[3] = vorrq_u8(a, vshlq_n_u8(a, 4));
+		vst4q_u8((uint8_t *)(dst + x), out);
+	}
+#endif
+
+	for (; x < n; x++)
+	{
+		uint8_t a = (src[x] >> alpha_shift) & 0x0f;
+		dst[x] = pal->color[(src[x] >> index_shift) & 0x0f] | ((a * 17) << 24);
+	}
+}
+
 VdpStatus rgba_put_bits_indexed(rgba_surface_t *rgba,
                                 VdpIndexedFormat source_indexed_format,
                                 void const *const *source_data,
@@ -135,43 +429,62 @@ VdpStatus rgba_put_bits_indexed(rgba_surface_t *rgba,
 	if (color_table_format != VDP_COLOR_TABLE_FORMAT_B8G8R8X8)
 		return VDP_STATUS_INVALID_COLOR_TABLE_FORMAT;
 
+	int num_colors;
+	switch (source_indexed_format)
+	{
+	case VDP_INDEXED_FORMAT_I8A8:
+	case VDP_INDEXED_FORMAT_A8I8:
+		num_colors = 256;
+		break;
+	case VDP_INDEXED_FORMAT_I4A4:
+	case VDP_INDEXED_FORMAT_A4I4:
+		num_colors = 16;
+		break;
+	default:
+		return VDP_STATUS_INVALID_INDEXED_FORMAT;
+	}
+
 	if (!rgba->device->osd_enabled)
 		return VDP_STATUS_OK;
 
-	int x, y;
-	const uint32_t *colormap = color_table;
+	if (rgba_alloc(rgba) != VDP_STATUS_OK)
+		return VDP_STATUS_RESOURCES;
+
+	int y;
+	struct palette pal;
 	const uint8_t *src_ptr = source_data[0];
-	uint32_t *dst_ptr = cedrus_mem_get_pointer(rgba->data);
+	uint32_t *dst_ptr = rgba->pixels;
 
 	VdpRect d_rect = {0, 0, rgba->width, rgba->height};
 	if (destination_rect)
 		d_rect = *destination_rect;
 
-	if ((rgba->flags & RGBA_FLAG_NEEDS_CLEAR) && !dirty_in_rect(&rgba->dirty, &d_rect))
+	if ((rgba->flags & RGBA_FLAG_NEEDS_CLEAR) && !region_in_rect(&rgba->dirty, &d_rect))
 		rgba_clear(rgba);
 
+	begin_cpu_access(rgba, &d_rect);
+
+	palette_init(&pal, color_table, num_colors, rgba->format);
+
 	dst_ptr += d_rect.y0 * rgba->width;
 	dst_ptr += d_rect.x0;
 
 	for (y = 0; y < d_rect.y1 - d_rect.y0; y++)
 	{
-		for (x = 0; x < d_rect.x1 - d_rect.x0; x++)
+		switch (source_indexed_format)
 		{
-			uint8_t i, a;
-			switch (source_indexed_format)
-			{
-			case VDP_INDEXED_FORMAT_I8A8:
-				i = src_ptr[x * 2];
-				a = src_ptr[x * 2 + 1];
-				break;
-			case VDP_INDEXED_FORMAT_A8I8:
-				a = src_ptr[x * 2];
-				i = src_ptr[x * 2 + 1];
-				break;
-			default:
-				return VDP_STATUS_INVALID_INDEXED_FORMAT;
-			}
-			dst_ptr[x] = (colormap[i] & 0x00ffffff) | (a << 24);
+		case VDP_INDEXED_FORMAT_I8A8:
+			expand_i8a8_row(dst_ptr, src_ptr, &pal, d_rect.x1 - d_rect.x0);
+			break;
+		case VDP_INDEXED_FORMAT_A8I8:
+			expand_a8i8_row(dst_ptr, src_ptr, &pal, d_rect.x1 - d_rect.x0);
+			break;
+		case VDP_INDEXED_FORMAT_I4A4:
+			expand_4bit_row(dst_ptr, src_ptr, &pal, d_rect.x1 - d_rect.x0, 4);
+			break;
+		default:
+			expand_4bit_row(dst_ptr, src_ptr, &pal, d_rect.x1 - d_rect.x0, 0);
+			break;
 		}
 		src_ptr += source_pitch[0];
 		dst_ptr += rgba->width;
@@ -179,11 +492,204 @@ VdpStatus rgba_put_bits_indexed(rgba_surface_t *rgba,
 
 	rgba->flags &= ~RGBA_FLAG_NEEDS_CLEAR;
 	rgba->flags |= RGBA_FLAG_DIRTY | RGBA_FLAG_NEEDS_FLUSH;
-	dirty_add_rect(&rgba->dirty, &d_rect);
+	region_add_rect(&rgba->dirty, &d_rect);
+	region_add_rect(&rgba->unflushed, &d_rect);
+
+	return VDP_STATUS_OK;
+}
+
+// splits one line into full resolution Y, Cb, Cr and alpha rows
+static void ycbcr_unpack_row(VdpYCbCrFormat format, void const *const *data, uint32_t const *pitches,
+                             unsigned int line, unsigned int n,
+                             uint8_t *y, uint8_t *cb, uint8_t *cr, uint8_t *a)
+{
+	unsigned int x;
+	const uint8_t *p = (const uint8_t *)data[0] + line * pitches[0];
+	const uint8_t *c1, *c2;
+
+	switch (format)
+	{
+	case VDP_YCBCR_FORMAT_YV12:
+		c1 = (const uint8_t *)data[2] + (line / 2) * pitches[2];
+		c2 = (const uint8_t *)data[1] + (line / 2) * pitches[1];
+		memcpy(y, p, n);
+		for (x = 0; x < n; x++)
+		{
+			cb[x] = c1[x / 2];
+			cr[x] = c2[x / 2];
+		}
+		break;
+	case VDP_YCBCR_FORMAT_NV12:
+		c1 = (const uint8_t *)data[1] + (line / 2) * pitches[1];
+		memcpy(y, p, n);
+		for (x = 0; x < n; x++)
+		{
+			cb[x] = c1[(x & ~1)];
+			cr[x] = c1[(x & ~1) + 1];
+		}
+		break;
+	case VDP_YCBCR_FORMAT_YUYV:
+		for (x = 0; x < n; x++)
+		{
+			y[x] = p[x * 2];
+			cb[x] = p[(x & ~1) * 2 + 1];
+			cr[x] = p[(x & ~1) * 2 + 3];
+		}
+		break;
+	case VDP_YCBCR_FORMAT_UYVY:
+		for (x = 0; x < n; x++)
+		{
+			y[x] = p[x * 2 + 1];
+			cb[x] = p[(x & ~1) * 2];
+			cr[x] = p[(x & ~1) * 2 + 2];
+		}
+		break;
+	case VDP_YCBCR_FORMAT_Y8U8V8A8:
+		for (x = 0; x < n; x++)
+		{
+			y[x] = p[x * 4];
+			cb[x] = p[x * 4 + 1];
+			cr[x] = p[x * 4 + 2];
+			a[x] = p[x * 4 + 3];
+		}
+		break;
+	case VDP_YCBCR_FORMAT_V8U8Y8A8:
+		for (x = 0; x < n; x++)
+		{
+			cr[x] = p[x * 4];
+			cb[x] = p[x * 4 + 1];
+			y[x] = p[x * 4 + 2];
+			a[x] = p[x * 4 + 3];
+		}
+		break;
+	}
+}
+
+VdpStatus rgba_put_bits_y_cb_cr(rgba_surface_t *rgba,
+                                VdpYCbCrFormat source_ycbcr_format,
+                                void const *const *source_data,
+                                uint32_t const *source_pitches,
+                                VdpRect const *destination_rect,
+                                VdpCSCMatrix const *csc_matrix)
+{
+	switch (source_ycbcr_format)
+	{
+	case VDP_YCBCR_FORMAT_YV12:
+	case VDP_YCBCR_FORMAT_NV12:
+	case VDP_YCBCR_FORMAT_YUYV:
+	case VDP_YCBCR_FORMAT_UYVY:
+	case VDP_YCBCR_FORMAT_Y8U8V8A8:
+	case VDP_YCBCR_FORMAT_V8U8Y8A8:
+		break;
+	default:
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+	}
+
+	if (!rgba->device->osd_enabled)
+		return VDP_STATUS_OK;
+
+	if (rgba_alloc(rgba) != VDP_STATUS_OK)
+		return VDP_STATUS_RESOURCES;
+
+	VdpRect d_rect = {0, 0, rgba->width, rgba->height};
+	if (destination_rect)
+		d_rect = *destination_rect;
+
+	if (d_rect.x0 >= d_rect.x1 || d_rect.y0 >= d_rect.y1)
+		return VDP_STATUS_OK;
+
+	// BT.601 if the client doesn't care
+	VdpCSCMatrix default_matrix;
+	if (!csc_matrix)
+	{
+		VdpProcamp procamp = { VDP_PROCAMP_VERSION, 0.0, 1.0, 1.0, 0.0 };
+		vdp_generate_csc_matrix(&procamp, VDP_COLOR_STANDARD_ITUR_BT_601, &default_matrix);
+		csc_matrix = &default_matrix;
+	}
+
+	yuv_csc_t csc;
+	yuv_csc_init(&csc, csc_matrix);
+
+	unsigned int n = d_rect.x1 - d_rect.x0, line;
+	uint8_t *rows = malloc(n * 4);
+	if (!rows)
+		return VDP_STATUS_RESOURCES;
+
+	uint8_t *y = rows, *cb = rows + n, *cr = rows + 2 * n, *a = rows + 3 * n;
+	memset(a, 0xff, n);
+
+	if ((rgba->flags & RGBA_FLAG_NEEDS_CLEAR) && !region_in_rect(&rgba->dirty, &d_rect))
+		rgba_clear(rgba);
+
+	begin_cpu_access(rgba, &d_rect);
+
+	uint8_t *dst = rgba->pixels + (d_rect.y0 * rgba->width + d_rect.x0) * 4;
+	for (line = 0; line < d_rect.y1 - d_rect.y0; line++)
+	{
+		ycbcr_unpack_row(source_ycbcr_format, source_data, source_pitches, line, n, y, cb, cr, a);
+		yuv_csc_row(dst, y, cb, cr, a, n, &csc, rgba->format == VDP_RGBA_FORMAT_B8G8R8A8);
+		dst += rgba->width * 4;
+	}
+
+	free(rows);
+
+	rgba->flags &= ~RGBA_FLAG_NEEDS_CLEAR;
+	rgba->flags |= RGBA_FLAG_DIRTY | RGBA_FLAG_NEEDS_FLUSH;
+	region_add_rect(&rgba->dirty, &d_rect);
+	region_add_rect(&rgba->unflushed, &d_rect);
 
 	return VDP_STATUS_OK;
 }
 
+/*
+ * The whole rect gets modulated with one colour, differing per-vertex
+ * colours would need a gradient and are averaged instead.
+ */
+static void modulation_color(VdpColor *color, VdpColor const *colors, uint32_t flags)
+{
+	int i;
+
+	*color = colors[0];
+	if (!(flags & VDP_OUTPUT_SURFACE_RENDER_COLOR_PER_VERTEX))
+		return;
+
+	for (i = 1; i < 4; i++)
+	{
+		if (memcmp(&colors[i], &colors[0], sizeof(VdpColor)) != 0)
+			VDPAU_DBG_ONCE("per-vertex colors not implemented, using average");
+
+		color->red += colors[i].red;
+		color->green += colors[i].green;
+		color->blue += colors[i].blue;
+		color->alpha += colors[i].alpha;
+	}
+
+	color->red /= 4;
+	color->green /= 4;
+	color->blue /= 4;
+	color->alpha /= 4;
+}
+
+static uint32_t float_to_u8(float f)
+{
+	return f <= 0.0 ? 0 : f >= 1.0 ? 255 : (uint32_t)(f * 255.0 + 0.5);
+}
+
+// A8R8G8B8 in the byte order of format, like rgba_fill() wants it
+static uint32_t color_to_pixel(const VdpColor *color, VdpRGBAFormat format)
+{
+	uint32_t r = float_to_u8(color->red), b = float_to_u8(color->blue);
+
+	if (format == VDP_RGBA_FORMAT_R8G8B8A8)
+	{
+		uint32_t tmp = r;
+		r = b;
+		b = tmp;
+	}
+
+	return (float_to_u8(color->alpha) << 24) | (r << 16) | (float_to_u8(color->green) << 8) | b;
+}
+
 VdpStatus rgba_render_surface(rgba_surface_t *dest,
                               VdpRect const *destination_rect,
                               rgba_surface_t *src,
@@ -195,9 +701,6 @@ VdpStatus rgba_render_surface(rgba_surface_t *dest,
 	if (!dest->device->osd_enabled)
 		return VDP_STATUS_OK;
 
-	if (colors || flags)
-		VDPAU_DBG_ONCE("%s: colors and flags not implemented!", __func__);
-
 	// set up source/destination rects using defaults where required
 	VdpRect s_rect = {0, 0, 0, 0};
 	VdpRect d_rect = {0, 0, dest->width, dest->height};
@@ -214,32 +717,41 @@ VdpStatus rgba_render_surface(rgba_surface_t *dest,
 	    d_rect.x0 == d_rect.x1 || d_rect.y0 == d_rect.y1)
 		return VDP_STATUS_OK;
 
-	if ((dest->flags & RGBA_FLAG_NEEDS_CLEAR) && !dirty_in_rect(&dest->dirty, &d_rect))
+	if (rgba_alloc(dest) != VDP_STATUS_OK || (src && rgba_alloc(src) != VDP_STATUS_OK))
+		return VDP_STATUS_RESOURCES;
+
+	if ((dest->flags & RGBA_FLAG_NEEDS_CLEAR) && !region_in_rect(&dest->dirty, &d_rect))
 		rgba_clear(dest);
 
+	VdpColor color = { 1.0, 1.0, 1.0, 1.0 };
+	if (colors)
+		modulation_color(&color, colors, flags);
+
+	// without source the white source texel gets modulated
 	if (!src)
-		rgba_fill(dest, &d_rect, 0xffffffff);
+		rgba_fill(dest, &d_rect, color_to_pixel(&color, dest->format));
 	else
-		rgba_blit(dest, &d_rect, src, &s_rect);
+		rgba_blit(dest, &d_rect, src, &s_rect, flags & 3, color_to_pixel(&color, src->format));
 
 	dest->flags &= ~RGBA_FLAG_NEEDS_CLEAR;
 	dest->flags |= RGBA_FLAG_DIRTY;
-	dirty_add_rect(&dest->dirty, &d_rect);
+	region_add_rect(&dest->dirty, &d_rect);
 
 	return VDP_STATUS_OK;
 }
 
 void rgba_clear(rgba_surface_t *rgba)
 {
+	int i;
+
 	if (!(rgba->flags & RGBA_FLAG_DIRTY))
 		return;
 
-	rgba_fill(rgba, &rgba->dirty, 0x00000000);
+	for (i = 0; i < rgba->dirty.num_rects; i++)
+		rgba_fill(rgba, &rgba->dirty.rects[i], 0x00000000);
+
 	rgba->flags &= ~(RGBA_FLAG_DIRTY | RGBA_FLAG_NEEDS_CLEAR);
-	rgba->dirty.x0 = rgba->width;
-	rgba->dirty.y0 = rgba->height;
-	rgba->dirty.x1 = 0;
-	rgba->dirty.y1 = 0;
+	region_clear(&rgba->dirty);
 }
 
 void rgba_fill(rgba_surface_t *dest, const VdpRect *dest_rect, uint32_t color)
@@ -250,16 +762,23 @@ void rgba_fill(rgba_surface_t *dest, const VdpRect *dest_rect, uint32_t color)
 		{
 			rgba_flush(dest);
 			g2d_fill(dest, dest_rect, color);
+			dest->flags |= RGBA_FLAG_NEEDS_INVALIDATE;
 		}
 		else
 		{
-			vdp_pixman_fill(dest, dest_rect, color);
+			VdpRect rect = { 0, 0, dest->width, dest->height };
+			if (dest_rect)
+				rect = *dest_rect;
+
+			vdp_pixman_fill(dest, &rect, color);
 			dest->flags |= RGBA_FLAG_NEEDS_FLUSH;
+			region_add_rect(&dest->unflushed, &rect);
 		}
 	}
 }
 
-void rgba_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect)
+void rgba_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect,
+               uint32_t rotation, uint32_t color)
 {
 	if (dest->device->osd_enabled)
 	{
@@ -267,21 +786,58 @@ void rgba_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *s
 		{
 			rgba_flush(dest);
 			rgba_flush(src);
-			g2d_blit(dest, dest_rect, src, src_rect);
+			if (g2d_blit(dest, dest_rect, src, src_rect, rotation, color))
+			{
+				dest->flags |= RGBA_FLAG_NEEDS_INVALIDATE;
+				return;
+			}
+
+			// not expressible with G2D, fall back to pixman on the CPU
+			begin_cpu_access(src, src_rect);
+			begin_cpu_access(dest, dest_rect);
+			vdp_pixman_ref(dest);
+			if (src != dest)
+				vdp_pixman_ref(src);
+
+			vdp_pixman_blit(dest, dest_rect, src, src_rect, rotation, color);
+
+			if (src != dest)
+				vdp_pixman_unref(src);
+			vdp_pixman_unref(dest);
+			dest->flags |= RGBA_FLAG_NEEDS_FLUSH;
+			region_add_rect(&dest->unflushed, dest_rect);
 		}
 		else
 		{
-			vdp_pixman_blit(dest, dest_rect, src, src_rect);
+			vdp_pixman_blit(dest, dest_rect, src, src_rect, rotation, color);
 			dest->flags |= RGBA_FLAG_NEEDS_FLUSH;
+			region_add_rect(&dest->unflushed, dest_rect);
 		}
 	}
 }
 
+void rgba_sync(rgba_surface_t *rgba)
+{
+	if (rgba->device->g2d_enabled)
+		g2d_sync(rgba->device);
+}
+
 void rgba_flush(rgba_surface_t *rgba)
 {
 	if (rgba->flags & RGBA_FLAG_NEEDS_FLUSH)
 	{
-		cedrus_mem_flush_cache(rgba->data);
+		/*
+		 * Only the lines touched by the CPU, heap memory is never seen
+		 * by hardware. One range over all of them, without range
+		 * maintenance each flush covers the whole buffer anyway.
+		 */
+		if (rgba->data && rgba->unflushed.num_rects > 0)
+		{
+			const VdpRect *b = &rgba->unflushed.bounds;
+			cache_flush_range(rgba->data, rgba->offset + b->y0 * rgba->width * 4, (b->y1 - b->y0) * rgba->width * 4);
+		}
+
+		region_clear(&rgba->unflushed);
 		rgba->flags &= ~RGBA_FLAG_NEEDS_FLUSH;
 	}
 }
@@ -26,7 +26,8 @@ VdpStatus rgba_create(rgba_surface_t *rgba,
                       device_ctx_t *device,
                       uint32_t width,
                       uint32_t height,
-                      VdpRGBAFormat format);
+                      VdpRGBAFormat format,
+                      int scanout);
 
 void rgba_destroy(rgba_surface_t *rgba);
 
@@ -35,6 +36,11 @@ VdpStatus rgba_put_bits_native(rgba_surface_t *rgba,
                                uint32_t const *source_pitches,
                                VdpRect const *destination_rect);
 
+VdpStatus rgba_get_bits_native(rgba_surface_t *rgba,
+                               VdpRect const *source_rect,
+                               void *const *destination_data,
+                               uint32_t const *destination_pitches);
+
 VdpStatus rgba_put_bits_indexed(rgba_surface_t *rgba,
                                 VdpIndexedFormat source_indexed_format,
                                 void const *const *source_data,
@@ -43,6 +49,13 @@ VdpStatus rgba_put_bits_indexed(rgba_surface_t *rgba,
                                 VdpColorTableFormat color_table_format,
                                 void const *color_table);
 
+VdpStatus rgba_put_bits_y_cb_cr(rgba_surface_t *rgba,
+                                VdpYCbCrFormat source_ycbcr_format,
+                                void const *const *source_data,
+                                uint32_t const *source_pitches,
+                                VdpRect const *destination_rect,
+                                VdpCSCMatrix const *csc_matrix);
+
 VdpStatus rgba_render_surface(rgba_surface_t *dest,
                               VdpRect const *destination_rect,
                               rgba_surface_t *src,
@@ -53,8 +66,10 @@ VdpStatus rgba_render_surface(rgba_surface_t *dest,
 
 void rgba_clear(rgba_surface_t *rgba);
 void rgba_fill(rgba_surface_t *dest, const VdpRect *dest_rect, uint32_t color);
-void rgba_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect);
+void rgba_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect,
+               uint32_t rotation, uint32_t color);
 
 void rgba_flush(rgba_surface_t *rgba);
+void rgba_sync(rgba_surface_t *rgba);
 
 #endif
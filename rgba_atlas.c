@@ -0,0 +1,160 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include <cedrus/cedrus.h>
+#include "vdpau_private.h"
+#include "rgba_atlas.h"
+
+/*
+ * Small bitmap surfaces (glyphs mostly) share contiguous pages instead
+ * of each getting its own page-rounded CMA block. Pages are split into
+ * cache-line sized slots, a surface gets a run of them and keeps its
+ * own pitch, so G2D and the CPU can access it like any other surface.
+ */
+#define ATLAS_PAGE_SIZE (256 * 1024)
+#define ATLAS_SLOT_SIZE 64
+#define ATLAS_SLOTS (ATLAS_PAGE_SIZE / ATLAS_SLOT_SIZE)
+
+struct atlas_page
+{
+	struct atlas_page *next;
+	cedrus_mem_t *mem;
+	unsigned int used;
+	uint32_t map[ATLAS_SLOTS / 32];
+};
+
+static int slot_used(const struct atlas_page *page, unsigned int slot)
+{
+	return page->map[slot / 32] & (1u << (slot % 32));
+}
+
+static void mark_slots(struct atlas_page *page, unsigned int first, unsigned int count, int used)
+{
+	unsigned int i;
+
+	for (i = first; i < first + count; i++)
+	{
+		if (used)
+			page->map[i / 32] |= 1u << (i % 32);
+		else
+			page->map[i / 32] &= ~(1u << (i % 32));
+	}
+
+	page->used = used ? page->used + count : page->used - count;
+}
+
+// first fit, returns ATLAS_SLOTS if there is no run long enough
+static unsigned int find_slots(const struct atlas_page *page, unsigned int count)
+{
+	unsigned int slot = 0, run = 0;
+
+	if (ATLAS_SLOTS - page->used < count)
+		return ATLAS_SLOTS;
+
+	while (slot < ATLAS_SLOTS)
+	{
+		// skip full words quickly
+		if (run == 0 && slot % 32 == 0 && page->map[slot / 32] == 0xffffffff)
+		{
+			slot += 32;
+			continue;
+		}
+
+		if (slot_used(page, slot))
+			run = 0;
+		else if (++run == count)
+			return slot + 1 - count;
+
+		slot++;
+	}
+
+	return ATLAS_SLOTS;
+}
+
+cedrus_mem_t *atlas_alloc(device_ctx_t *device, uint32_t size, uint32_t *offset)
+{
+	unsigned int count = (size + ATLAS_SLOT_SIZE - 1) / ATLAS_SLOT_SIZE;
+	unsigned int slot;
+	struct atlas_page *page;
+
+	for (page = device->atlas; page; page = page->next)
+	{
+		slot = find_slots(page, count);
+		if (slot != ATLAS_SLOTS)
+			break;
+	}
+
+	if (!page)
+	{
+		page = calloc(1, sizeof(*page));
+		if (!page)
+			return NULL;
+
+		page->mem = cedrus_mem_alloc(device->cedrus, ATLAS_PAGE_SIZE);
+		if (!page->mem)
+		{
+			free(page);
+			return NULL;
+		}
+
+		page->next = device->atlas;
+		device->atlas = page;
+		slot = 0;
+	}
+
+	mark_slots(page, slot, count, 1);
+	*offset = slot * ATLAS_SLOT_SIZE;
+
+	return page->mem;
+}
+
+void atlas_free(device_ctx_t *device, cedrus_mem_t *mem, uint32_t offset, uint32_t size)
+{
+	struct atlas_page **p;
+
+	for (p = &device->atlas; *p; p = &(*p)->next)
+	{
+		struct atlas_page *page = *p;
+		if (page->mem != mem)
+			continue;
+
+		mark_slots(page, offset / ATLAS_SLOT_SIZE, (size + ATLAS_SLOT_SIZE - 1) / ATLAS_SLOT_SIZE, 0);
+
+		// give empty pages back, unless it's the only one
+		if (page->used == 0 && (page != device->atlas || page->next))
+		{
+			*p = page->next;
+			cedrus_mem_free(page->mem);
+			free(page);
+		}
+
+		return;
+	}
+}
+
+void atlas_destroy(device_ctx_t *device)
+{
+	while (device->atlas)
+	{
+		struct atlas_page *page = device->atlas;
+		device->atlas = page->next;
+		cedrus_mem_free(page->mem);
+		free(page);
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __RGBA_ATLAS_H__
+#define __RGBA_ATLAS_H__
+
+#include "vdpau_private.h"
+
+/*
+ * Surfaces up to this many bytes get packed into shared pages. Only arm64
+ * can flush part of a page, on 32-bit every glyph would flush all of it.
+ */
+#ifdef __aarch64__
+#define ATLAS_MAX_SURFACE_SIZE (16 * 1024)
+#else
+#define ATLAS_MAX_SURFACE_SIZE 0
+#endif
+
+cedrus_mem_t *atlas_alloc(device_ctx_t *device, uint32_t size, uint32_t *offset);
+void atlas_free(device_ctx_t *device, cedrus_mem_t *mem, uint32_t offset, uint32_t size);
+void atlas_destroy(device_ctx_t *device);
+
+#endif
@@ -18,65 +18,235 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <cedrus/cedrus.h>
 #include <sys/ioctl.h>
 #include "vdpau_private.h"
+#include "rgba_g2d.h"
 #include "kernel-headers/g2d_driver.h"
 
+/*
+ * Fills and blits are only recorded here and issued by g2d_sync().
+ * The G2D driver has no multi-command ioctl, so every command that
+ * survives still costs one ioctl. Queueing only saves the commands
+ * dropped by drop_covered() and the repeated cache flushes. There is
+ * one queue per device to keep the order between surfaces, a blit
+ * still has to read its source before a later command changes it.
+ */
+#define G2D_MAX_QUEUED 64
+
+struct g2d_cmd
+{
+	unsigned long request;
+	rgba_surface_t *dest;
+	rgba_surface_t *src;
+	VdpRect dest_rect;
+	union
+	{
+		g2d_fillrect fill;
+		g2d_blt blt;
+		g2d_stretchblt stretch;
+	} args;
+};
+
+static int rect_in_rect(const VdpRect *inner, const VdpRect *outer)
+{
+	return inner->x0 >= outer->x0 && inner->y0 >= outer->y0 &&
+	       inner->x1 <= outer->x1 && inner->y1 <= outer->y1;
+}
+
+/*
+ * Drop queued commands whose result would be overwritten by a
+ * command replacing dest_rect, unless something reads it in between.
+ */
+static void drop_covered(device_ctx_t *device, rgba_surface_t *dest, const VdpRect *dest_rect)
+{
+	int i;
+
+	for (i = device->g2d_num_cmds - 1; i >= 0; i--)
+	{
+		struct g2d_cmd *cmd = &device->g2d_cmds[i];
+
+		if (cmd->src == dest)
+			break;
+
+		if (cmd->dest == dest && cmd->request && rect_in_rect(&cmd->dest_rect, dest_rect))
+			cmd->request = 0;
+	}
+}
+
+static struct g2d_cmd *queue_cmd(device_ctx_t *device, unsigned long request,
+                                 rgba_surface_t *dest, const VdpRect *dest_rect,
+                                 rgba_surface_t *src, int replaces)
+{
+	if (replaces)
+		drop_covered(device, dest, dest_rect);
+
+	if (device->g2d_num_cmds == G2D_MAX_QUEUED)
+		g2d_sync(device);
+
+	if (!device->g2d_cmds)
+	{
+		device->g2d_cmds = malloc(G2D_MAX_QUEUED * sizeof(struct g2d_cmd));
+		if (!device->g2d_cmds)
+			return NULL;
+	}
+
+	struct g2d_cmd *cmd = &device->g2d_cmds[device->g2d_num_cmds++];
+	cmd->request = request;
+	cmd->dest = dest;
+	cmd->src = src;
+	cmd->dest_rect = *dest_rect;
+
+	return cmd;
+}
+
+static void submit(device_ctx_t *device, struct g2d_cmd *cmd)
+{
+	if (ioctl(device->g2d_fd, cmd->request, &cmd->args) != 0)
+		VDPAU_DBG("G2D request 0x%lx failed", cmd->request);
+}
+
+static void set_image(g2d_image *image, rgba_surface_t *rgba)
+{
+	image->addr[0] = cedrus_mem_get_phys_addr(rgba->data) + rgba->offset;
+	image->w = rgba->width;
+	image->h = rgba->height;
+	image->format = G2D_FMT_ARGB_AYUV8888;
+	image->pixel_seq = G2D_SEQ_NORMAL;
+}
+
+static void set_rect(g2d_rect *g2d, const VdpRect *rect)
+{
+	g2d->x = rect->x0;
+	g2d->y = rect->y0;
+	g2d->w = rect->x1 - rect->x0;
+	g2d->h = rect->y1 - rect->y0;
+}
+
 void g2d_fill(rgba_surface_t *dest, const VdpRect *dest_rect, uint32_t color)
 {
-	g2d_fillrect args;
-
-	args.flag = G2D_FIL_PIXEL_ALPHA;
-	args.dst_image.addr[0] = cedrus_mem_get_phys_addr(dest->data);
-	args.dst_image.w = dest->width;
-	args.dst_image.h = dest->height;
-	args.dst_image.format = G2D_FMT_ARGB_AYUV8888;
-	args.dst_image.pixel_seq = G2D_SEQ_NORMAL;
+	device_ctx_t *device = dest->device;
+	VdpRect rect = { 0, 0, dest->width, dest->height };
 	if (dest_rect)
+		rect = *dest_rect;
+
+	struct g2d_cmd cmd_buf, *cmd = queue_cmd(device, G2D_CMD_FILLRECT, dest, &rect, NULL, 1);
+	if (!cmd)
+		cmd = &cmd_buf;
+
+	g2d_fillrect *args = &cmd->args.fill;
+	args->flag = G2D_FIL_PIXEL_ALPHA;
+	set_image(&args->dst_image, dest);
+	set_rect(&args->dst_rect, &rect);
+	args->color = color & 0xffffff ;
+	args->alpha = color >> 24;
+
+	if (cmd == &cmd_buf)
+	{
+		cmd->request = G2D_CMD_FILLRECT;
+		submit(device, cmd);
+	}
+}
+
+/*
+ * Rotation is clockwise for both VDPAU and G2D, scaling needs a stretch
+ * blit. Colour modulation can only be done if it is alpha only, by
+ * multiplying with the plane alpha, anything else returns 0 and is left
+ * to the caller.
+ */
+int g2d_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect,
+             uint32_t rotation, uint32_t color)
+{
+	static const uint32_t rotate_flags[4] =
+		{ 0, G2D_BLT_ROTATE90, G2D_BLT_ROTATE180, G2D_BLT_ROTATE270 };
+
+	device_ctx_t *device = dest->device;
+	uint32_t flag = (dest->flags & RGBA_FLAG_NEEDS_CLEAR) ? G2D_BLT_NONE : G2D_BLT_PIXEL_ALPHA;
+	uint32_t alpha = color >> 24;
+
+	if ((color & 0xffffff) != 0xffffff)
+		return 0;
+
+	if (alpha != 0xff)
+	{
+		// blending with plane alpha can't replace the destination
+		if (flag == G2D_BLT_NONE)
+			return 0;
+		flag = G2D_BLT_MULTI_ALPHA;
+	}
+
+	flag |= rotate_flags[rotation & 3];
+
+	int src_w = src_rect->x1 - src_rect->x0, src_h = src_rect->y1 - src_rect->y0;
+	if (rotation & 1)
+	{
+		int tmp = src_w;
+		src_w = src_h;
+		src_h = tmp;
+	}
+
+	int stretch = (dest_rect->x1 - dest_rect->x0 != src_w) || (dest_rect->y1 - dest_rect->y0 != src_h);
+	VdpRect rect = *dest_rect;
+	if (!stretch)
+	{
+		rect.x1 = rect.x0 + src_w;
+		rect.y1 = rect.y0 + src_h;
+	}
+
+	unsigned long request = stretch ? G2D_CMD_STRETCHBLT : G2D_CMD_BITBLT;
+	struct g2d_cmd cmd_buf, *cmd = queue_cmd(device, request, dest, &rect, src, flag == G2D_BLT_NONE && src != dest);
+	if (!cmd)
+		cmd = &cmd_buf;
+
+	if (stretch)
 	{
-		args.dst_rect.x = dest_rect->x0;
-		args.dst_rect.y = dest_rect->y0;
-		args.dst_rect.w = dest_rect->x1 - dest_rect->x0;
-		args.dst_rect.h = dest_rect->y1 - dest_rect->y0;
+		g2d_stretchblt *args = &cmd->args.stretch;
+		args->flag = flag;
+		set_image(&args->src_image, src);
+		set_rect(&args->src_rect, src_rect);
+		set_image(&args->dst_image, dest);
+		set_rect(&args->dst_rect, &rect);
+		args->color = 0;
+		args->alpha = alpha;
 	}
 	else
 	{
-		args.dst_rect.x = 0;
-		args.dst_rect.y = 0;
-		args.dst_rect.w = dest->width;
-		args.dst_rect.h = dest->height;
+		g2d_blt *args = &cmd->args.blt;
+		args->flag = flag;
+		set_image(&args->src_image, src);
+		set_rect(&args->src_rect, src_rect);
+		set_image(&args->dst_image, dest);
+		args->dst_x = rect.x0;
+		args->dst_y = rect.y0;
+		args->color = 0;
+		args->alpha = alpha;
 	}
-	args.color = color & 0xffffff ;
-	args.alpha = color >> 24;
 
-	ioctl(dest->device->g2d_fd, G2D_CMD_FILLRECT, &args);
+	if (cmd == &cmd_buf)
+	{
+		cmd->request = request;
+		submit(device, cmd);
+	}
+
+	return 1;
+}
+
+void g2d_sync(device_ctx_t *device)
+{
+	unsigned int i;
+
+	for (i = 0; i < device->g2d_num_cmds; i++)
+		if (device->g2d_cmds[i].request)
+			submit(device, &device->g2d_cmds[i]);
+
+	device->g2d_num_cmds = 0;
 }
 
-void g2d_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect)
+void g2d_close(device_ctx_t *device)
 {
-	g2d_blt args;
-
-	args.flag = (dest->flags & RGBA_FLAG_NEEDS_CLEAR) ? G2D_BLT_NONE : G2D_BLT_PIXEL_ALPHA;
-	args.src_image.addr[0] = cedrus_mem_get_phys_addr(src->data);
-	args.src_image.w = src->width;
-	args.src_image.h = src->height;
-	args.src_image.format = G2D_FMT_ARGB_AYUV8888;
-	args.src_image.pixel_seq = G2D_SEQ_NORMAL;
-	args.src_rect.x = src_rect->x0;
-	args.src_rect.y = src_rect->y0;
-	args.src_rect.w = src_rect->x1 - src_rect->x0;
-	args.src_rect.h = src_rect->y1 - src_rect->y0;
-	args.dst_image.addr[0] = cedrus_mem_get_phys_addr(dest->data);
-	args.dst_image.w = dest->width;
-	args.dst_image.h = dest->height;
-	args.dst_image.format = G2D_FMT_ARGB_AYUV8888;
-	args.dst_image.pixel_seq = G2D_SEQ_NORMAL;
-	args.dst_x = dest_rect->x0;
-	args.dst_y = dest_rect->y0;
-	args.color = 0;
-	args.alpha = 0;
-
-	ioctl(dest->device->g2d_fd, G2D_CMD_BITBLT, &args);
+	g2d_sync(device);
+	free(device->g2d_cmds);
+	device->g2d_cmds = NULL;
 }
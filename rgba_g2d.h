@@ -21,6 +21,10 @@
 #define __RGBA_G2D_H__
 
 void g2d_fill(rgba_surface_t *dest, const VdpRect *dest_rect, uint32_t color);
-void g2d_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect);
+int g2d_blit(rgba_surface_t *dest, const VdpRect *dest_rect, rgba_surface_t *src, const VdpRect *src_rect,
+             uint32_t rotation, uint32_t color);
+
+void g2d_sync(device_ctx_t *device);
+void g2d_close(device_ctx_t *device);
 
 #endif
@@ -48,13 +48,24 @@ static pixman_color_t uint32_to_pcolor(uint32_t color)
 	return pcolor;
 }
 
+// the same color as a premultiplied a8r8g8b8 pixel
+static uint32_t uint32_to_pixel(uint32_t color)
+{
+	pixman_color_t pcolor = uint32_to_pcolor(color);
+
+	return ((pcolor.alpha >> 8) << 24) | ((pcolor.red >> 8) << 16) |
+	       ((pcolor.green >> 8) << 8) | (pcolor.blue >> 8);
+}
+
 VdpStatus vdp_pixman_ref(rgba_surface_t *rgba)
 {
 	rgba->pimage = pixman_image_create_bits(PIXMAN_a8r8g8b8,
 						rgba->width, rgba->height,
-						cedrus_mem_get_pointer(rgba->data),
+						rgba->pixels,
 						(rgba->width * 4));
 
+	pixman_transform_init_identity(&rgba->ptransform);
+
 	return VDP_STATUS_OK;
 }
 
@@ -65,41 +76,100 @@ VdpStatus vdp_pixman_unref(rgba_surface_t *rgba)
 	return VDP_STATUS_OK;
 }
 
+static pixman_fixed_t ratio(int num, int den)
+{
+	return ((int64_t)num << 16) / den;
+}
+
 VdpStatus vdp_pixman_blit(rgba_surface_t *rgba_dst, const VdpRect *dst_rect,
-			  rgba_surface_t *rgba_src, const VdpRect *src_rect)
+			  rgba_surface_t *rgba_src, const VdpRect *src_rect,
+			  uint32_t rotation, uint32_t color)
 {
 	pixman_image_t *dst;
 	pixman_image_t *src;
-	pixman_transform_t transform;
-	double fscale_x, fscale_y;
+	pixman_image_t *mask = NULL;
 	int pixman_operator;
 
 	dst = rgba_dst->pimage;
 	src = rgba_src->pimage;
 
-	if ((dst_rect->x1 - dst_rect->x0) == 0 ||
-	    (src_rect->x1 - src_rect->x0) == 0 ||
-	    (dst_rect->y1 - dst_rect->y0) == 0 ||
-	    (src_rect->y1 - src_rect->y0) == 0 )
+	int dst_w = dst_rect->x1 - dst_rect->x0, dst_h = dst_rect->y1 - dst_rect->y0;
+	int src_w = src_rect->x1 - src_rect->x0, src_h = src_rect->y1 - src_rect->y0;
+
+	if (dst_w == 0 || src_w == 0 || dst_h == 0 || src_h == 0)
 		goto zero_size_blit;
 
-	/* Transform src_rct to dest_rct size */
-	fscale_x = (double)(dst_rect->x1 - dst_rect->x0) / (double)(src_rect->x1 - src_rect->x0);
-	fscale_y = (double)(dst_rect->y1 - dst_rect->y0) / (double)(src_rect->y1 - src_rect->y0);
+	/*
+	 * The transform maps destination to source space. 1:1 blits go
+	 * without transform, which keeps pixman on its fast paths, all
+	 * others map the destination rect relative to its origin onto the
+	 * source image, rotating clockwise like VDPAU wants.
+	 */
+	pixman_transform_t transform;
 	pixman_transform_init_identity(&transform);
-	pixman_transform_scale(&transform, NULL,
-			       pixman_double_to_fixed(fscale_x),
-			       pixman_double_to_fixed(fscale_y));
-	pixman_image_set_transform(src, &transform);
+	int src_x = src_rect->x0, src_y = src_rect->y0;
+	int transformed = 0;
+	if (rotation != VDP_OUTPUT_SURFACE_RENDER_ROTATE_0 || src_w != dst_w || src_h != dst_h)
+	{
+		pixman_fixed_t (*m)[3] = transform.matrix;
+		m[0][0] = m[1][1] = 0;
+		m[0][2] = pixman_int_to_fixed(src_rect->x0);
+		m[1][2] = pixman_int_to_fixed(src_rect->y0);
+
+		switch (rotation)
+		{
+		case VDP_OUTPUT_SURFACE_RENDER_ROTATE_90:
+			m[0][1] = ratio(src_w, dst_h);
+			m[1][0] = -ratio(src_h, dst_w);
+			m[1][2] += pixman_int_to_fixed(src_h);
+			break;
+		case VDP_OUTPUT_SURFACE_RENDER_ROTATE_180:
+			m[0][0] = -ratio(src_w, dst_w);
+			m[1][1] = -ratio(src_h, dst_h);
+			m[0][2] += pixman_int_to_fixed(src_w);
+			m[1][2] += pixman_int_to_fixed(src_h);
+			break;
+		case VDP_OUTPUT_SURFACE_RENDER_ROTATE_270:
+			m[0][1] = -ratio(src_w, dst_h);
+			m[1][0] = ratio(src_h, dst_w);
+			m[0][2] += pixman_int_to_fixed(src_w);
+			break;
+		default:
+			m[0][0] = ratio(src_w, dst_w);
+			m[1][1] = ratio(src_h, dst_h);
+			break;
+		}
+		src_x = 0;
+		src_y = 0;
+		transformed = 1;
+	}
+
+	// the transform stays set on the source image, only update it on changes
+	if (memcmp(&transform, &rgba_src->ptransform, sizeof(transform)) != 0)
+	{
+		pixman_image_set_transform(src, transformed ? &transform : NULL);
+		rgba_src->ptransform = transform;
+	}
+
+	// colour modulation through a component alpha mask
+	if (color != 0xffffffff)
+	{
+		pixman_color_t pcolor = uint32_to_pcolor(color);
+		mask = pixman_image_create_solid_fill(&pcolor);
+		pixman_image_set_component_alpha(mask, 1);
+	}
 
 	/* Composite to the dest_img */
 	pixman_operator = (rgba_dst->flags & RGBA_FLAG_NEEDS_CLEAR) ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
 	pixman_image_composite32(
-		pixman_operator, src, NULL, dst,
-		(src_rect->x0 * fscale_x), (src_rect->y0 * fscale_y),
+		pixman_operator, src, mask, dst,
+		src_x, src_y,
 		0, 0,
 		dst_rect->x0, dst_rect->y0,
-		(dst_rect->x1 - dst_rect->x0), (dst_rect->y1 - dst_rect->y0));
+		dst_w, dst_h);
+
+	if (mask)
+		pixman_image_unref(mask);
 
 	return VDP_STATUS_OK;
 
@@ -133,6 +203,12 @@ VdpStatus vdp_pixman_fill(rgba_surface_t *rgba_dst, const VdpRect *dst_rect,
 	    (rect.y1 - rect.y0) == 0)
 		goto zero_size_fill;
 
+	/* Plain solid fill, no need for a temporary image */
+	if (pixman_fill(rgba_dst->pixels, rgba_dst->width, 32,
+			rect.x0, rect.y0, rect.x1 - rect.x0, rect.y1 - rect.y0,
+			uint32_to_pixel(color)))
+		return VDP_STATUS_OK;
+
 	pixman_color_t pcolor = uint32_to_pcolor(color);
 	pixman_image_t *src = pixman_image_create_solid_fill(&pcolor);
 
@@ -23,7 +23,8 @@
 VdpStatus vdp_pixman_ref(rgba_surface_t *rgba);
 VdpStatus vdp_pixman_unref(rgba_surface_t *rgba);
 VdpStatus vdp_pixman_blit(rgba_surface_t *dst, const VdpRect *dst_rect,
-			  rgba_surface_t *src, const VdpRect *src_rect);
+			  rgba_surface_t *src, const VdpRect *src_rect,
+			  uint32_t rotation, uint32_t color);
 VdpStatus vdp_pixman_fill(rgba_surface_t *dst, const VdpRect *dst_rect,
 			  uint32_t color);
 
@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include "kernel-headers/sunxi_disp_ioctl.h"
@@ -31,70 +32,175 @@ struct sunxi_disp_private
 	struct sunxi_disp pub;
 
 	int fd;
+	struct sunxi_vsync *vsync;
+	struct sunxi_disp_layer *video, *osd;
 	int video_layer;
 	int osd_layer;
 	__disp_layer_info_t video_info;
 	__disp_layer_info_t osd_info;
+	__disp_layer_info_t video_committed, osd_committed;
+	int video_open, osd_open;
+	struct sunxi_disp_layer *extra[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	__disp_layer_info_t extra_info[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	__disp_layer_info_t extra_committed[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	int extra_open[SUNXI_DISP_MAX_EXTRA_LAYERS];
 };
 
+static void sunxi_disp_device_close(struct sunxi_disp_device *device);
+static struct sunxi_disp *sunxi_disp_open_target(struct sunxi_disp_device *device);
 static void sunxi_disp_close(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp_close_video_layer(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp_close_osd_layer(struct sunxi_disp *sunxi_disp);
+static int sunxi_disp_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer);
+static void sunxi_disp_close_extra_layer(struct sunxi_disp *sunxi_disp, int index);
+static int sunxi_disp_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp);
 
-struct sunxi_disp *sunxi_disp_open(int osd_enabled)
+struct sunxi_disp_device *sunxi_disp_open(int osd_enabled)
 {
-	struct sunxi_disp_private *disp = calloc(1, sizeof(*disp));
+	struct sunxi_disp_device *device = calloc(1, sizeof(*device));
 
-	disp->fd = open("/dev/disp", O_RDWR);
-	if (disp->fd == -1)
+	device->fd = open("/dev/disp", O_RDWR);
+	if (device->fd == -1)
 		goto err_open;
 
 	int tmp = SUNXI_DISP_VERSION;
-	if (ioctl(disp->fd, DISP_CMD_VERSION, &tmp) < 0)
+	if (ioctl(device->fd, DISP_CMD_VERSION, &tmp) < 0)
 		goto err_version;
 
-	uint32_t args[4] = { 0, DISP_LAYER_WORK_MODE_SCALER, 0, 0 };
-	disp->video_layer = ioctl(disp->fd, DISP_CMD_LAYER_REQUEST, args);
-	if (disp->video_layer == 0)
+	if (!osd_enabled)
+	{
+		__disp_colorkey_t ck;
+		ck.ck_max.red = ck.ck_min.red = 0;
+		ck.ck_max.green = ck.ck_min.green = 1;
+		ck.ck_max.blue = ck.ck_min.blue = 2;
+		ck.red_match_rule = 2;
+		ck.green_match_rule = 2;
+		ck.blue_match_rule = 2;
+
+		uint32_t args[4] = { 0, (unsigned long)(&ck), 0, 0 };
+		ioctl(device->fd, DISP_CMD_SET_COLORKEY, args);
+	}
+
+	device->osd_enabled = osd_enabled;
+	device->background_layer = 1;
+	device->open_target = sunxi_disp_open_target;
+	device->close = sunxi_disp_device_close;
+
+	return device;
+
+err_version:
+	close(device->fd);
+err_open:
+	free(device);
+	return NULL;
+}
+
+static void sunxi_disp_device_close(struct sunxi_disp_device *device)
+{
+	uint32_t args[4] = { 0, 0, 0, 0 };
+	int i;
+
+	for (i = 0; i < device->num_layers; i++)
+	{
+		args[1] = device->layers[i].id;
+		ioctl(device->fd, DISP_CMD_LAYER_RELEASE, args);
+	}
+
+	close(device->fd);
+	free(device);
+}
+
+// layers are requested from the driver on demand, but only released with the device
+static struct sunxi_disp_layer *get_layer(struct sunxi_disp_device *device, int scaler)
+{
+	struct sunxi_disp_layer *layer = sunxi_disp_layer_get(device, scaler);
+	if (layer)
+		return layer;
+
+	uint32_t args[4] = { 0, scaler ? DISP_LAYER_WORK_MODE_SCALER : DISP_LAYER_WORK_MODE_NORMAL, 0, 0 };
+	int id = ioctl(device->fd, DISP_CMD_LAYER_REQUEST, args);
+	if (id == 0)
+		return NULL;
+
+	if (!sunxi_disp_layer_add(device, id, scaler))
+	{
+		args[1] = id;
+		ioctl(device->fd, DISP_CMD_LAYER_RELEASE, args);
+		return NULL;
+	}
+
+	return sunxi_disp_layer_get(device, scaler);
+}
+
+static void init_rgba_info(__disp_layer_info_t *info)
+{
+	info->pipe = 1;
+	info->mode = DISP_LAYER_WORK_MODE_NORMAL;
+	info->fb.mode = DISP_MOD_INTERLEAVED;
+	info->fb.format = DISP_FORMAT_ARGB8888;
+	info->fb.seq = DISP_SEQ_ARGB;
+	info->fb.cs_mode = DISP_BT601;
+}
+
+static struct sunxi_disp *sunxi_disp_open_target(struct sunxi_disp_device *device)
+{
+	struct sunxi_disp_private *disp = calloc(1, sizeof(*disp));
+
+	disp->fd = device->fd;
+
+	disp->video = get_layer(device, 1);
+	if (!disp->video)
 		goto err_video_layer;
+	disp->video_layer = disp->video->id;
 
-	args[1] = disp->video_layer;
-	ioctl(disp->fd, osd_enabled ? DISP_CMD_LAYER_TOP : DISP_CMD_LAYER_BOTTOM, args);
+	uint32_t args[4] = { 0, disp->video_layer, 0, 0 };
+	ioctl(disp->fd, device->osd_enabled ? DISP_CMD_LAYER_TOP : DISP_CMD_LAYER_BOTTOM, args);
 
-	if (osd_enabled)
+	if (device->osd_enabled)
 	{
-		args[1] = DISP_LAYER_WORK_MODE_NORMAL;
-		disp->osd_layer = ioctl(disp->fd, DISP_CMD_LAYER_REQUEST, args);
-		if (disp->osd_layer == 0)
+		disp->osd = get_layer(device, 0);
+		if (!disp->osd)
 			goto err_osd_layer;
+		disp->osd_layer = disp->osd->id;
+
+		init_rgba_info(&disp->osd_info);
+
+		// extra layers are optional, take what the driver still has
+		int i;
+		for (i = 0; i < SUNXI_DISP_MAX_EXTRA_LAYERS; i++)
+		{
+			disp->extra[i] = get_layer(device, 0);
+			if (!disp->extra[i])
+				break;
+			init_rgba_info(&disp->extra_info[i]);
+		}
+		disp->pub.num_extra_layers = i;
+
+		// background, video, mixer layers, OSD
+		if (disp->pub.num_extra_layers > 0)
+		{
+			// pipe 1 is blended above pipe 0, the background has to share the video's
+			disp->extra_info[0].pipe = 0;
+			args[1] = disp->extra[0]->id;
+			ioctl(disp->fd, DISP_CMD_LAYER_TOP, args);
+			args[1] = disp->video_layer;
+			ioctl(disp->fd, DISP_CMD_LAYER_TOP, args);
+		}
+		for (i = 1; i < disp->pub.num_extra_layers; i++)
+		{
+			args[1] = disp->extra[i]->id;
+			ioctl(disp->fd, DISP_CMD_LAYER_TOP, args);
+		}
 
 		args[1] = disp->osd_layer;
 		ioctl(disp->fd, DISP_CMD_LAYER_TOP, args);
-
-		disp->osd_info.pipe = 1;
-		disp->osd_info.mode = DISP_LAYER_WORK_MODE_NORMAL;
-		disp->osd_info.fb.mode = DISP_MOD_INTERLEAVED;
-		disp->osd_info.fb.format = DISP_FORMAT_ARGB8888;
-		disp->osd_info.fb.seq = DISP_SEQ_ARGB;
-		disp->osd_info.fb.cs_mode = DISP_BT601;
 	}
 	else
 	{
 		disp->video_info.pipe = 1;
 		disp->video_info.ck_enable = 1;
-
-		__disp_colorkey_t ck;
-		ck.ck_max.red = ck.ck_min.red = 0;
-		ck.ck_max.green = ck.ck_min.green = 1;
-		ck.ck_max.blue = ck.ck_min.blue = 2;
-		ck.red_match_rule = 2;
-		ck.green_match_rule = 2;
-		ck.blue_match_rule = 2;
-
-		args[1] = (unsigned long)(&ck);
-		ioctl(disp->fd, DISP_CMD_SET_COLORKEY, args);
 	}
 
 	disp->video_info.mode = DISP_LAYER_WORK_MODE_SCALER;
@@ -106,16 +212,17 @@ struct sunxi_disp *sunxi_disp_open(int osd_enabled)
 	disp->pub.close_video_layer = sunxi_disp_close_video_layer;
 	disp->pub.set_osd_layer = sunxi_disp_set_osd_layer;
 	disp->pub.close_osd_layer = sunxi_disp_close_osd_layer;
+	disp->pub.set_extra_layer = sunxi_disp_set_extra_layer;
+	disp->pub.close_extra_layer = sunxi_disp_close_extra_layer;
+	disp->pub.wait_for_vsync = sunxi_disp_wait_for_vsync;
+
+	disp->vsync = sunxi_vsync_open(device, 0);
 
 	return (struct sunxi_disp *)disp;
 
 err_osd_layer:
-	args[1] = disp->osd_layer;
-	ioctl(disp->fd, DISP_CMD_LAYER_RELEASE, args);
+	sunxi_disp_layer_put(disp->video);
 err_video_layer:
-err_version:
-	close(disp->fd);
-err_open:
 	free(disp);
 	return NULL;
 }
@@ -126,24 +233,79 @@ static void sunxi_disp_close(struct sunxi_disp *sunxi_disp)
 
 	uint32_t args[4] = { 0, disp->video_layer, 0, 0 };
 	ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
-	ioctl(disp->fd, DISP_CMD_LAYER_RELEASE, args);
+	sunxi_disp_layer_put(disp->video);
 
-	if (disp->osd_layer)
+	if (disp->osd)
 	{
 		args[1] = disp->osd_layer;
 		ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
-		ioctl(disp->fd, DISP_CMD_LAYER_RELEASE, args);
+		sunxi_disp_layer_put(disp->osd);
 	}
 
-	close(disp->fd);
+	int i;
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+	{
+		args[1] = disp->extra[i]->id;
+		ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
+		sunxi_disp_layer_put(disp->extra[i]);
+	}
+
+	sunxi_vsync_close(disp->vsync);
 	free(sunxi_disp);
 }
 
+/*
+ * Issues the cheapest update from the last committed state, nothing if
+ * the layer didn't change and only the framebuffer if just the plane
+ * addresses did.
+ */
+static void commit_layer(struct sunxi_disp_private *disp, int layer, __disp_layer_info_t *info,
+                         __disp_layer_info_t *committed, int *open)
+{
+	uint32_t args[4] = { 0, layer, (unsigned long)info, 0 };
+
+	if (*open && memcmp(info, committed, sizeof(*info)) == 0)
+		return;
+
+	__disp_layer_info_t same_addr = *info;
+	memcpy(same_addr.fb.addr, committed->fb.addr, sizeof(same_addr.fb.addr));
+
+	if (*open && memcmp(&same_addr, committed, sizeof(same_addr)) == 0)
+	{
+		args[2] = (unsigned long)(&info->fb);
+		ioctl(disp->fd, DISP_CMD_LAYER_SET_FB, args);
+	}
+	else
+	{
+		ioctl(disp->fd, DISP_CMD_LAYER_SET_PARA, args);
+		if (!*open)
+			ioctl(disp->fd, DISP_CMD_LAYER_OPEN, args);
+	}
+
+	*committed = *info;
+	*open = 1;
+}
+
+static void close_layer(struct sunxi_disp_private *disp, int layer, int *open)
+{
+	uint32_t args[4] = { 0, layer, 0, 0 };
+
+	if (!*open)
+		return;
+
+	ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
+	*open = 0;
+}
+
 static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
 {
 	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
+	int i;
+
+	const surface_layout_t *layout = &surface->video_layout;
+	const VdpRect *src = &surface->video_src_rect;
 
-	switch (surface->vs->source_format) {
+	switch (layout->format) {
 	case VDP_YCBCR_FORMAT_YUYV:
 		disp->video_info.fb.mode = DISP_MOD_INTERLEAVED;
 		disp->video_info.fb.format = DISP_FORMAT_YUV422;
@@ -172,16 +334,16 @@ static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 		break;
 	}
 
-	disp->video_info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->yuv->data);
-	disp->video_info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
-	disp->video_info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
+	for (i = 0; i < 3; i++)
+		disp->video_info.fb.addr[i] = i < layout->num_planes ? cedrus_mem_get_phys_addr(surface->yuv->data) + layout->plane[i].offset : 0;
 
-	disp->video_info.fb.size.width = surface->vs->width;
-	disp->video_info.fb.size.height = surface->vs->height;
-	disp->video_info.src_win.x = surface->video_src_rect.x0;
-	disp->video_info.src_win.y = surface->video_src_rect.y0;
-	disp->video_info.src_win.width = surface->video_src_rect.x1 - surface->video_src_rect.x0;
-	disp->video_info.src_win.height = surface->video_src_rect.y1 - surface->video_src_rect.y0;
+	// planes are padded, the pitch is taken from the width
+	disp->video_info.fb.size.width = layout->plane[0].width;
+	disp->video_info.fb.size.height = surface->video_height;
+	disp->video_info.src_win.x = src->x0;
+	disp->video_info.src_win.y = src->y0;
+	disp->video_info.src_win.width = src->x1 - src->x0;
+	disp->video_info.src_win.height = src->y1 - src->y0;
 	disp->video_info.scn_win.x = x + surface->video_dst_rect.x0;
 	disp->video_info.scn_win.y = y + surface->video_dst_rect.y0;
 	disp->video_info.scn_win.width = surface->video_dst_rect.x1 - surface->video_dst_rect.x0;
@@ -197,10 +359,7 @@ static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 		disp->video_info.scn_win.height -= scn_clip;
 	}
 
-	uint32_t args[4] = { 0, disp->video_layer, (unsigned long)(&disp->video_info), 0 };
-	ioctl(disp->fd, DISP_CMD_LAYER_SET_PARA, args);
-
-	ioctl(disp->fd, DISP_CMD_LAYER_OPEN, args);
+	commit_layer(disp, disp->video_layer, &disp->video_info, &disp->video_committed, &disp->video_open);
 
 	// Note: might be more reliable (but slower and problematic when there
 	// are driver issues and the GET functions return wrong values) to query the
@@ -209,6 +368,7 @@ static int sunxi_disp_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 	// set doing this unconditionally is costly.
 	if (surface->csc_change)
 	{
+		uint32_t args[4] = { 0, disp->video_layer, 0, 0 };
 		ioctl(disp->fd, DISP_CMD_LAYER_ENHANCE_OFF, args);
 		args[2] = 0xff * surface->brightness + 0x20;
 		ioctl(disp->fd, DISP_CMD_LAYER_SET_BRIGHT, args);
@@ -230,41 +390,42 @@ static void sunxi_disp_close_video_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
 
-	uint32_t args[4] = { 0, disp->video_layer, 0, 0 };
-	ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
+	close_layer(disp, disp->video_layer, &disp->video_open);
 }
 
-static int sunxi_disp_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+static void set_rgba_info(__disp_layer_info_t *info, int x, int y, int width, int height, rgba_surface_t *rgba, const VdpRect *src, const VdpRect *dst)
 {
-	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
-
-	switch (surface->rgba.format)
+	switch (rgba->format)
 	{
 	case VDP_RGBA_FORMAT_R8G8B8A8:
-		disp->osd_info.fb.br_swap = 1;
+		info->fb.br_swap = 1;
 		break;
 	case VDP_RGBA_FORMAT_B8G8R8A8:
 	default:
-		disp->osd_info.fb.br_swap = 0;
+		info->fb.br_swap = 0;
 		break;
 	}
 
-	disp->osd_info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->rgba.data);
-	disp->osd_info.fb.size.width = surface->rgba.width;
-	disp->osd_info.fb.size.height = surface->rgba.height;
-	disp->osd_info.src_win.x = surface->rgba.dirty.x0;
-	disp->osd_info.src_win.y = surface->rgba.dirty.y0;
-	disp->osd_info.src_win.width = surface->rgba.dirty.x1 - surface->rgba.dirty.x0;
-	disp->osd_info.src_win.height = surface->rgba.dirty.y1 - surface->rgba.dirty.y0;
-	disp->osd_info.scn_win.x = x + surface->rgba.dirty.x0;
-	disp->osd_info.scn_win.y = y + surface->rgba.dirty.y0;
-	disp->osd_info.scn_win.width = min_nz(width, surface->rgba.dirty.x1) - surface->rgba.dirty.x0;
-	disp->osd_info.scn_win.height = min_nz(height, surface->rgba.dirty.y1) - surface->rgba.dirty.y0;
+	info->fb.addr[0] = cedrus_mem_get_phys_addr(rgba->data);
+	info->fb.size.width = rgba->width;
+	info->fb.size.height = rgba->height;
+	info->src_win.x = src->x0;
+	info->src_win.y = src->y0;
+	info->src_win.width = src->x1 - src->x0;
+	info->src_win.height = src->y1 - src->y0;
+	info->scn_win.x = x + dst->x0;
+	info->scn_win.y = y + dst->y0;
+	info->scn_win.width = min_nz(width, dst->x1) - dst->x0;
+	info->scn_win.height = min_nz(height, dst->y1) - dst->y0;
+}
+
+static int sunxi_disp_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+{
+	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
 
-	uint32_t args[4] = { 0, disp->osd_layer, (unsigned long)(&disp->osd_info), 0 };
-	ioctl(disp->fd, DISP_CMD_LAYER_SET_PARA, args);
+	set_rgba_info(&disp->osd_info, x, y, width, height, &surface->rgba, &surface->rgba.dirty.bounds, &surface->rgba.dirty.bounds);
 
-	ioctl(disp->fd, DISP_CMD_LAYER_OPEN, args);
+	commit_layer(disp, disp->osd_layer, &disp->osd_info, &disp->osd_committed, &disp->osd_open);
 
 	return 0;
 }
@@ -273,6 +434,31 @@ static void sunxi_disp_close_osd_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
 
-	uint32_t args[4] = { 0, disp->osd_layer, 0, 0 };
-	ioctl(disp->fd, DISP_CMD_LAYER_CLOSE, args);
+	close_layer(disp, disp->osd_layer, &disp->osd_open);
+}
+
+static int sunxi_disp_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer)
+{
+	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
+	VdpRect src = { 0, 0, layer->rgba.width, layer->rgba.height };
+
+	set_rgba_info(&disp->extra_info[index], x, y, width, height, &layer->rgba, &src, &layer->dst);
+
+	commit_layer(disp, disp->extra[index]->id, &disp->extra_info[index], &disp->extra_committed[index], &disp->extra_open[index]);
+
+	return 0;
+}
+
+static void sunxi_disp_close_extra_layer(struct sunxi_disp *sunxi_disp, int index)
+{
+	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
+
+	close_layer(disp, disp->extra[index]->id, &disp->extra_open[index]);
+}
+
+static int sunxi_disp_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp)
+{
+	struct sunxi_disp_private *disp = (struct sunxi_disp_private *)sunxi_disp;
+
+	return sunxi_vsync_wait(disp->vsync, timestamp);
 }
@@ -20,7 +20,10 @@
 #ifndef SUNXI_DISP_H_
 #define SUNXI_DISP_H_
 
+#include <stdint.h>
+
 typedef struct output_surface_ctx_struct output_surface_ctx_t;
+typedef struct mixer_layer_struct mixer_layer_t;
 
 struct sunxi_disp
 {
@@ -29,10 +32,75 @@ struct sunxi_disp
 	void (*close_video_layer)(struct sunxi_disp *sunxi_disp);
 	int (*set_osd_layer)(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 	void (*close_osd_layer)(struct sunxi_disp *sunxi_disp);
+	int (*wait_for_vsync)(struct sunxi_disp *sunxi_disp, uint64_t *timestamp);
+	// applies all layer changes at once, if the layer functions defer them
+	int (*commit)(struct sunxi_disp *sunxi_disp);
+	/*
+	 * RGBA layers for the video mixer between video and OSD. With
+	 * background_layer set on the device, the first one is below the
+	 * video for the background instead.
+	 */
+	int num_extra_layers;
+	int (*set_extra_layer)(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer);
+	void (*close_extra_layer)(struct sunxi_disp *sunxi_disp, int index);
+};
+
+/*
+ * /dev/disp is probed and opened once per device, the presentation queue
+ * targets share it and take their layers from a common pool.
+ */
+#define SUNXI_DISP_MAX_LAYERS 8
+#define SUNXI_DISP_MAX_EXTRA_LAYERS 3
+
+struct sunxi_disp_layer
+{
+	int id;
+	int scaler;
+	int in_use;
+	unsigned int zorder;
+};
+
+struct sunxi_disp_device
+{
+	int fd;
+	int osd_enabled;
+	unsigned int screen_width;
+	struct sunxi_disp *(*open_target)(struct sunxi_disp_device *device);
+	void (*close)(struct sunxi_disp_device *device);
+	int num_layers;
+	struct sunxi_disp_layer layers[SUNXI_DISP_MAX_LAYERS];
+	// extra layers every open target has
+	int num_targets;
+	int extra_layers;
+	// if the first extra layer can be stacked below the video
+	int background_layer;
+	// targets using the driver's vsync events, and if they are on
+	int vsync_users;
+	int vsync_events;
 };
 
-struct sunxi_disp *sunxi_disp_open(int osd_enabled);
-struct sunxi_disp *sunxi_disp2_open(int osd_enabled);
-struct sunxi_disp *sunxi_disp1_5_open(int osd_enabled);
+struct sunxi_disp_device *sunxi_disp_probe(int osd_enabled);
+struct sunxi_disp_device *sunxi_disp_open(int osd_enabled);
+struct sunxi_disp_device *sunxi_disp2_open(int osd_enabled);
+struct sunxi_disp_device *sunxi_disp1_5_open(int osd_enabled);
+
+/*
+ * A layer handed out is stacked above all layers in use, so a target's
+ * OSD ends up above its video and newer targets above older ones.
+ */
+int sunxi_disp_layer_add(struct sunxi_disp_device *device, int id, int scaler);
+struct sunxi_disp_layer *sunxi_disp_layer_get(struct sunxi_disp_device *device, int scaler);
+void sunxi_disp_layer_put(struct sunxi_disp_layer *layer);
+int sunxi_disp_layer_get_extra(struct sunxi_disp_device *device, struct sunxi_disp_layer *video,
+                               struct sunxi_disp_layer *osd, struct sunxi_disp_layer **extra);
+
+/*
+ * Blocks until the next vertical blank and returns its CLOCK_MONOTONIC
+ * timestamp in ns. event_cmd enables the driver's vsync events, 0 if
+ * it has none.
+ */
+struct sunxi_vsync *sunxi_vsync_open(struct sunxi_disp_device *device, unsigned long event_cmd);
+int sunxi_vsync_wait(struct sunxi_vsync *vsync, uint64_t *timestamp);
+void sunxi_vsync_close(struct sunxi_vsync *vsync);
 
 #endif
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include "kernel-headers/drv_display.h"
@@ -32,30 +33,106 @@ struct sunxi_disp1_5_private
 	struct sunxi_disp pub;
 
 	int fd;
+	struct sunxi_vsync *vsync;
+	struct sunxi_disp_layer *video, *osd;
 	disp_layer_info video_info;
 	int video_layer;
 	disp_layer_info osd_info;
 	int osd_layer;
 	unsigned int screen_width;
+	disp_layer_info video_committed, osd_committed;
+	int video_enabled, osd_enabled;
+	struct sunxi_disp_layer *extra[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	disp_layer_info extra_info[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	disp_layer_info extra_committed[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	int extra_enabled[SUNXI_DISP_MAX_EXTRA_LAYERS];
 };
 
+static void sunxi_disp1_5_device_close(struct sunxi_disp_device *device);
+static struct sunxi_disp *sunxi_disp1_5_open_target(struct sunxi_disp_device *device);
 static void sunxi_disp1_5_close(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp1_5_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp1_5_close_video_layer(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp1_5_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp1_5_close_osd_layer(struct sunxi_disp *sunxi_disp);
+static int sunxi_disp1_5_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer);
+static void sunxi_disp1_5_close_extra_layer(struct sunxi_disp *sunxi_disp, int index);
+static int sunxi_disp1_5_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp);
 
-struct sunxi_disp *sunxi_disp1_5_open(int osd_enabled)
+struct sunxi_disp_device *sunxi_disp1_5_open(int osd_enabled)
 {
-	struct sunxi_disp1_5_private *disp = calloc(1, sizeof(*disp));
+	struct sunxi_disp_device *device = calloc(1, sizeof(*device));
 
-	disp->fd = open("/dev/disp", O_RDWR);
-	if (disp->fd == -1)
+	device->fd = open("/dev/disp", O_RDWR);
+	if (device->fd == -1)
 		goto err_open;
 
+	// layer 0 is the framebuffer, only the first layer above it gets a scaler
+	unsigned long args[4] = { 0, 1 };
+	if (ioctl(device->fd, DISP_CMD_LAYER_DISABLE, args))
+		goto err_probe;
+
+	sunxi_disp_layer_add(device, 1, 1);
+	sunxi_disp_layer_add(device, 2, 0);
+	sunxi_disp_layer_add(device, 3, 0);
+
+	device->screen_width = ioctl(device->fd, DISP_CMD_GET_SCN_WIDTH, args);
+	device->osd_enabled = osd_enabled;
+	device->background_layer = 1;
+	device->open_target = sunxi_disp1_5_open_target;
+	device->close = sunxi_disp1_5_device_close;
+
+	return device;
+
+err_probe:
+	close(device->fd);
+err_open:
+	free(device);
+	return NULL;
+}
+
+static void sunxi_disp1_5_device_close(struct sunxi_disp_device *device)
+{
+	close(device->fd);
+	free(device);
+}
+
+static void init_rgba_info(disp_layer_info *info, struct sunxi_disp_layer *layer)
+{
+	info->mode = DISP_LAYER_WORK_MODE_NORMAL;
+	info->alpha_mode = 0;
+	info->alpha_value = 255;
+	info->pipe = 0;
+	info->ck_enable = 0;
+	info->b_trd_out = 0;
+	info->zorder = layer->zorder;
+}
+
+static struct sunxi_disp *sunxi_disp1_5_open_target(struct sunxi_disp_device *device)
+{
+	struct sunxi_disp1_5_private *disp = calloc(1, sizeof(*disp));
+	int i;
+
+	disp->fd = device->fd;
+
+	disp->video = sunxi_disp_layer_get(device, 1);
+	if (!disp->video)
+		goto err_video_layer;
+
+	if (device->osd_enabled)
+	{
+		disp->osd = sunxi_disp_layer_get(device, 0);
+		if (!disp->osd)
+			goto err_osd_layer;
+
+		disp->pub.num_extra_layers = sunxi_disp_layer_get_extra(device, disp->video, disp->osd, disp->extra);
+		for (i = 0; i < disp->pub.num_extra_layers; i++)
+			init_rgba_info(&disp->extra_info[i], disp->extra[i]);
+	}
+
 	unsigned long args[4] = { 0, 0, (unsigned long) &disp->video_info };
 
-	disp->video_layer = 1;
+	disp->video_layer = disp->video->id;
 	args[1] = disp->video_layer;
 
 	disp->video_info.mode = DISP_LAYER_WORK_MODE_SCALER;
@@ -64,48 +141,51 @@ struct sunxi_disp *sunxi_disp1_5_open(int osd_enabled)
 	disp->video_info.pipe = 1;
 	disp->video_info.ck_enable = 0;
 	disp->video_info.b_trd_out = 0;
-	disp->video_info.zorder = 1;
+	disp->video_info.zorder = disp->video->zorder;
 
 	if (ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args))
-		goto err_video_layer;
+		goto err_video_info;
 
 	if (ioctl(disp->fd, DISP_CMD_LAYER_SET_INFO, args))
-		goto err_video_layer;
+		goto err_video_info;
 
-	if (osd_enabled)
+	if (disp->osd)
 	{
-		disp->osd_layer = 2;
+		disp->osd_layer = disp->osd->id;
 		args[1] = disp->osd_layer;
 		args[2] = (unsigned long)&disp->osd_info;
 
-		disp->osd_info.mode = DISP_LAYER_WORK_MODE_NORMAL;
-		disp->osd_info.alpha_mode = 0;
-		disp->osd_info.alpha_value = 255;
-		disp->osd_info.pipe = 0;
-		disp->osd_info.ck_enable = 0;
-		disp->osd_info.b_trd_out = 0;
-		disp->osd_info.zorder = 2;
+		init_rgba_info(&disp->osd_info, disp->osd);
 
 		if (ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args))
-			goto err_video_layer;
+			goto err_video_info;
 
 		if (ioctl(disp->fd, DISP_CMD_LAYER_SET_INFO, args))
-			goto err_video_layer;
+			goto err_video_info;
 	}
 
-	disp->screen_width = ioctl(disp->fd, DISP_CMD_GET_SCN_WIDTH, args);
+	disp->screen_width = device->screen_width;
 
 	disp->pub.close = sunxi_disp1_5_close;
 	disp->pub.set_video_layer = sunxi_disp1_5_set_video_layer;
 	disp->pub.close_video_layer = sunxi_disp1_5_close_video_layer;
 	disp->pub.set_osd_layer = sunxi_disp1_5_set_osd_layer;
 	disp->pub.close_osd_layer = sunxi_disp1_5_close_osd_layer;
+	disp->pub.set_extra_layer = sunxi_disp1_5_set_extra_layer;
+	disp->pub.close_extra_layer = sunxi_disp1_5_close_extra_layer;
+	disp->pub.wait_for_vsync = sunxi_disp1_5_wait_for_vsync;
+
+	disp->vsync = sunxi_vsync_open(device, DISP_CMD_VSYNC_EVENT_EN);
 
 	return (struct sunxi_disp *)disp;
 
+err_video_info:
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+		sunxi_disp_layer_put(disp->extra[i]);
+	sunxi_disp_layer_put(disp->osd);
+err_osd_layer:
+	sunxi_disp_layer_put(disp->video);
 err_video_layer:
-	close(disp->fd);
-err_open:
 	free(disp);
 	return NULL;
 }
@@ -117,21 +197,64 @@ static void sunxi_disp1_5_close(struct sunxi_disp *sunxi_disp)
 	unsigned long args[4] = { 0, disp->video_layer };
 
 	ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+	sunxi_disp_layer_put(disp->video);
 
-	if (disp->osd_layer)
+	if (disp->osd)
 	{
 		args[1] = disp->osd_layer;
 		ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+		sunxi_disp_layer_put(disp->osd);
+	}
+
+	int i;
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+	{
+		args[1] = disp->extra[i]->id;
+		ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+		sunxi_disp_layer_put(disp->extra[i]);
 	}
 
-	close(disp->fd);
+	sunxi_vsync_close(disp->vsync);
 	free(sunxi_disp);
 }
 
+// enable and reconfigure only what changed since the last commit
+static int commit_layer(struct sunxi_disp1_5_private *disp, int layer, disp_layer_info *info,
+                        disp_layer_info *committed, int *enabled)
+{
+	unsigned long args[4] = { 0, layer, (unsigned long)info };
+
+	if (*enabled && memcmp(info, committed, sizeof(*info)) == 0)
+		return 0;
+
+	if (!*enabled && ioctl(disp->fd, DISP_CMD_LAYER_ENABLE, args))
+		return -EINVAL;
+	*enabled = 1;
+
+	if (ioctl(disp->fd, DISP_CMD_LAYER_SET_INFO, args))
+		return -EINVAL;
+
+	*committed = *info;
+	return 0;
+}
+
+static void disable_layer(struct sunxi_disp1_5_private *disp, int layer, int *enabled)
+{
+	unsigned long args[4] = { 0, layer };
+
+	if (!*enabled)
+		return;
+
+	ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+	*enabled = 0;
+}
+
 static int sunxi_disp1_5_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
 {
 	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
+	int i;
 
+	const surface_layout_t *layout = &surface->video_layout;
 	disp_window src = { .x = surface->video_src_rect.x0, .y = surface->video_src_rect.y0,
 			    .width = surface->video_src_rect.x1 - surface->video_src_rect.x0,
 			    .height = surface->video_src_rect.y1 - surface->video_src_rect.y0 };
@@ -165,8 +288,7 @@ static int sunxi_disp1_5_set_video_layer(struct sunxi_disp *sunxi_disp, int x, i
 		src.width -= src_clip;
 	}
 
-	unsigned long args[4] = { 0, disp->video_layer, (unsigned long)(&disp->video_info) };
-	switch (surface->vs->source_format)
+	switch (layout->format)
 	{
 	case VDP_YCBCR_FORMAT_YUYV:
 		disp->video_info.fb.format = DISP_FORMAT_YUV422_I_YUYV;
@@ -186,78 +308,89 @@ static int sunxi_disp1_5_set_video_layer(struct sunxi_disp *sunxi_disp, int x, i
 		break;
 	}
 
-	disp->video_info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->yuv->data);
-	disp->video_info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
-	disp->video_info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
+	for (i = 0; i < 3; i++)
+		disp->video_info.fb.addr[i] = i < layout->num_planes ? cedrus_mem_get_phys_addr(surface->yuv->data) + layout->plane[i].offset : 0;
 
-	disp->video_info.fb.size.width = surface->vs->width;
-	disp->video_info.fb.size.height = surface->vs->height;
+	// planes are padded, the pitch is taken from the width
+	disp->video_info.fb.size.width = layout->plane[0].width;
+	disp->video_info.fb.size.height = surface->video_height;
 	disp->video_info.fb.src_win = src;
 	disp->video_info.screen_win = scn;
 	disp->video_info.fb.pre_multiply = 1;
 
-	if (ioctl(disp->fd, DISP_CMD_LAYER_ENABLE, args))
-		return -EINVAL;
-
-	if (ioctl(disp->fd, DISP_CMD_LAYER_SET_INFO, args))
-		return -EINVAL;
-
-	return 0;
+	return commit_layer(disp, disp->video_layer, &disp->video_info, &disp->video_committed, &disp->video_enabled);
 }
 
 static void sunxi_disp1_5_close_video_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
 
-	unsigned long args[4] = { 0, disp->video_layer };
-
-	ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+	disable_layer(disp, disp->video_layer, &disp->video_enabled);
 }
 
-static int sunxi_disp1_5_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+static void set_rgba_info(disp_layer_info *info, int x, int y, int width, int height, rgba_surface_t *rgba, const VdpRect *src_rect, const VdpRect *dst_rect)
 {
-	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
-
-	unsigned long args[4] = { 0, disp->osd_layer, (unsigned long)(&disp->osd_info) };
-
-	disp_window src = { .x = surface->rgba.dirty.x0, .y = surface->rgba.dirty.y0,
-			  .width = surface->rgba.dirty.x1 - surface->rgba.dirty.x0,
-			  .height = surface->rgba.dirty.y1 - surface->rgba.dirty.y0 };
-	disp_window scn = { .x = x + surface->rgba.dirty.x0, .y = y + surface->rgba.dirty.y0,
-			  .width = min_nz(width, surface->rgba.dirty.x1) - surface->rgba.dirty.x0,
-			  .height = min_nz(height, surface->rgba.dirty.y1) - surface->rgba.dirty.y0 };
-
-	switch (surface->rgba.format)
+	disp_window src = { .x = src_rect->x0, .y = src_rect->y0,
+			  .width = src_rect->x1 - src_rect->x0,
+			  .height = src_rect->y1 - src_rect->y0 };
+	disp_window scn = { .x = x + dst_rect->x0, .y = y + dst_rect->y0,
+			  .width = min_nz(width, dst_rect->x1) - dst_rect->x0,
+			  .height = min_nz(height, dst_rect->y1) - dst_rect->y0 };
+
+	switch (rgba->format)
 	{
 	case VDP_RGBA_FORMAT_R8G8B8A8:
-		disp->osd_info.fb.format = DISP_FORMAT_ABGR_8888;
+		info->fb.format = DISP_FORMAT_ABGR_8888;
 		break;
 	case VDP_RGBA_FORMAT_B8G8R8A8:
 	default:
-		disp->osd_info.fb.format = DISP_FORMAT_ARGB_8888;
+		info->fb.format = DISP_FORMAT_ARGB_8888;
 		break;
 	}
 
-	disp->osd_info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->rgba.data);
-	disp->osd_info.fb.size.width = surface->rgba.width;
-	disp->osd_info.fb.size.height = surface->rgba.height;
-	disp->osd_info.fb.src_win = src;
-	disp->osd_info.screen_win = scn;
+	info->fb.addr[0] = cedrus_mem_get_phys_addr(rgba->data);
+	info->fb.size.width = rgba->width;
+	info->fb.size.height = rgba->height;
+	info->fb.src_win = src;
+	info->screen_win = scn;
+}
 
-	if (ioctl(disp->fd, DISP_CMD_LAYER_ENABLE, args))
-		return -EINVAL;
+static int sunxi_disp1_5_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+{
+	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
 
-	if (ioctl(disp->fd, DISP_CMD_LAYER_SET_INFO, args))
-		return -EINVAL;
+	set_rgba_info(&disp->osd_info, x, y, width, height, &surface->rgba, &surface->rgba.dirty.bounds, &surface->rgba.dirty.bounds);
 
-	return 0;
+	return commit_layer(disp, disp->osd_layer, &disp->osd_info, &disp->osd_committed, &disp->osd_enabled);
 }
 
 static void sunxi_disp1_5_close_osd_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
 
-	unsigned long args[4] = { 0, disp->osd_layer };
+	disable_layer(disp, disp->osd_layer, &disp->osd_enabled);
+}
 
-	ioctl(disp->fd, DISP_CMD_LAYER_DISABLE, args);
+static int sunxi_disp1_5_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer)
+{
+	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
+	VdpRect src = { 0, 0, layer->rgba.width, layer->rgba.height };
+
+	set_rgba_info(&disp->extra_info[index], x, y, width, height, &layer->rgba, &src, &layer->dst);
+
+	return commit_layer(disp, disp->extra[index]->id, &disp->extra_info[index], &disp->extra_committed[index], &disp->extra_enabled[index]);
+}
+
+static void sunxi_disp1_5_close_extra_layer(struct sunxi_disp *sunxi_disp, int index)
+{
+	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
+
+	disable_layer(disp, disp->extra[index]->id, &disp->extra_enabled[index]);
+}
+
+static int sunxi_disp1_5_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp)
+{
+	struct sunxi_disp1_5_private *disp = (struct sunxi_disp1_5_private *)sunxi_disp;
+
+	return sunxi_vsync_wait(disp->vsync, timestamp);
 }
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include "kernel-headers/sunxi_display2.h"
@@ -32,25 +33,117 @@ struct sunxi_disp2_private
 	struct sunxi_disp pub;
 
 	int fd;
+	struct sunxi_vsync *vsync;
+	struct sunxi_disp_layer *video, *osd;
 	disp_layer_config video_config;
 	unsigned int screen_width;
 	disp_layer_config osd_config;
+	disp_layer_config video_committed, osd_committed;
+	struct sunxi_disp_layer *extra[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	disp_layer_config extra_config[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	disp_layer_config extra_committed[SUNXI_DISP_MAX_EXTRA_LAYERS];
 };
 
+static void sunxi_disp2_device_close(struct sunxi_disp_device *device);
+static struct sunxi_disp *sunxi_disp2_open_target(struct sunxi_disp_device *device);
 static void sunxi_disp2_close(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp2_close_video_layer(struct sunxi_disp *sunxi_disp);
 static int sunxi_disp2_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface);
 static void sunxi_disp2_close_osd_layer(struct sunxi_disp *sunxi_disp);
+static int sunxi_disp2_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer);
+static void sunxi_disp2_close_extra_layer(struct sunxi_disp *sunxi_disp, int index);
+static int sunxi_disp2_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp);
+static int sunxi_disp2_commit(struct sunxi_disp *sunxi_disp);
 
-struct sunxi_disp *sunxi_disp2_open(int osd_enabled)
+// pool layer ids are the channel and the layer within it
+#define LAYER_ID(channel, layer)	(((channel) << 2) | (layer))
+
+struct sunxi_disp_device *sunxi_disp2_open(int osd_enabled)
 {
-	struct sunxi_disp2_private *disp = calloc(1, sizeof(*disp));
+	struct sunxi_disp_device *device = calloc(1, sizeof(*device));
 
-	disp->fd = open("/dev/disp", O_RDWR);
-	if (disp->fd == -1)
+	device->fd = open("/dev/disp", O_RDWR);
+	if (device->fd == -1)
 		goto err_open;
 
+	// disabling the video layer fails with anything but disp2
+	disp_layer_config config;
+	memset(&config, 0, sizeof(config));
+	config.info.mode = LAYER_MODE_BUFFER;
+	unsigned long args[4] = { 0, (unsigned long)(&config), 1, 0 };
+
+	if (ioctl(device->fd, DISP_LAYER_SET_CONFIG, args))
+		goto err_probe;
+
+	/*
+	 * Only channel 0 takes YUV, OSD and mixer layers go to the layers of
+	 * channel 2. Channels are blended as a whole, so there is no layer
+	 * below the video for the mixer background, it gets composited.
+	 */
+	sunxi_disp_layer_add(device, LAYER_ID(0, 0), 1);
+	sunxi_disp_layer_add(device, LAYER_ID(2, 0), 0);
+	sunxi_disp_layer_add(device, LAYER_ID(2, 1), 0);
+	sunxi_disp_layer_add(device, LAYER_ID(2, 2), 0);
+	sunxi_disp_layer_add(device, LAYER_ID(2, 3), 0);
+
+	device->screen_width = ioctl(device->fd, DISP_GET_SCN_WIDTH, args);
+	device->osd_enabled = osd_enabled;
+	device->open_target = sunxi_disp2_open_target;
+	device->close = sunxi_disp2_device_close;
+
+	return device;
+
+err_probe:
+	close(device->fd);
+err_open:
+	free(device);
+	return NULL;
+}
+
+static void sunxi_disp2_device_close(struct sunxi_disp_device *device)
+{
+	close(device->fd);
+	free(device);
+}
+
+static void init_rgba_config(disp_layer_config *config, struct sunxi_disp_layer *layer)
+{
+	config->info.mode = LAYER_MODE_BUFFER;
+	config->info.alpha_mode = 0;
+	config->info.alpha_value = 255;
+
+	config->enable = 0;
+	config->channel = layer->id >> 2;
+	config->layer_id = layer->id & 0x3;
+	config->info.zorder = layer->zorder;
+}
+
+static struct sunxi_disp *sunxi_disp2_open_target(struct sunxi_disp_device *device)
+{
+	struct sunxi_disp2_private *disp = calloc(1, sizeof(*disp));
+	int i;
+
+	disp->fd = device->fd;
+
+	disp->video = sunxi_disp_layer_get(device, 1);
+	if (!disp->video)
+		goto err_video_layer;
+
+	if (device->osd_enabled)
+	{
+		disp->osd = sunxi_disp_layer_get(device, 0);
+		if (!disp->osd)
+			goto err_osd_layer;
+
+		disp->pub.num_extra_layers = sunxi_disp_layer_get_extra(device, disp->video, disp->osd, disp->extra);
+		for (i = 0; i < disp->pub.num_extra_layers; i++)
+		{
+			init_rgba_config(&disp->extra_config[i], disp->extra[i]);
+			disp->extra_committed[i] = disp->extra_config[i];
+		}
+	}
+
 	unsigned long args[4] = { 0, (unsigned long)(&disp->video_config), 1, 0 };
 
 	disp->video_config.info.mode = LAYER_MODE_BUFFER;
@@ -58,42 +151,47 @@ struct sunxi_disp *sunxi_disp2_open(int osd_enabled)
 	disp->video_config.info.alpha_value = 255;
 
 	disp->video_config.enable = 0;
-	disp->video_config.channel = 0;
-	disp->video_config.layer_id = 0;
-	disp->video_config.info.zorder = 1;
+	disp->video_config.channel = disp->video->id >> 2;
+	disp->video_config.layer_id = disp->video->id & 0x3;
+	disp->video_config.info.zorder = disp->video->zorder;
 
 	if (ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args))
-		goto err_video_layer;
+		goto err_video_config;
 
-	if (osd_enabled)
+	if (disp->osd)
 	{
-		disp->osd_config.info.mode = LAYER_MODE_BUFFER;
-		disp->osd_config.info.alpha_mode = 0;
-		disp->osd_config.info.alpha_value = 255;
-
-		disp->osd_config.enable = 0;
-		disp->osd_config.channel = 2;
-		disp->osd_config.layer_id = 0;
-		disp->osd_config.info.zorder = 2;
+		init_rgba_config(&disp->osd_config, disp->osd);
 
 		args[1] = (unsigned long)(&disp->osd_config);
 		if (ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args))
-			goto err_video_layer;
+			goto err_video_config;
 	}
 
-	disp->screen_width = ioctl(disp->fd, DISP_GET_SCN_WIDTH, args);
+	disp->screen_width = device->screen_width;
+	disp->video_committed = disp->video_config;
+	disp->osd_committed = disp->osd_config;
 
 	disp->pub.close = sunxi_disp2_close;
 	disp->pub.set_video_layer = sunxi_disp2_set_video_layer;
 	disp->pub.close_video_layer = sunxi_disp2_close_video_layer;
 	disp->pub.set_osd_layer = sunxi_disp2_set_osd_layer;
 	disp->pub.close_osd_layer = sunxi_disp2_close_osd_layer;
+	disp->pub.set_extra_layer = sunxi_disp2_set_extra_layer;
+	disp->pub.close_extra_layer = sunxi_disp2_close_extra_layer;
+	disp->pub.wait_for_vsync = sunxi_disp2_wait_for_vsync;
+	disp->pub.commit = sunxi_disp2_commit;
+
+	disp->vsync = sunxi_vsync_open(device, DISP_VSYNC_EVENT_EN);
 
 	return (struct sunxi_disp *)disp;
 
+err_video_config:
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+		sunxi_disp_layer_put(disp->extra[i]);
+	sunxi_disp_layer_put(disp->osd);
+err_osd_layer:
+	sunxi_disp_layer_put(disp->video);
 err_video_layer:
-	close(disp->fd);
-err_open:
 	free(disp);
 	return NULL;
 }
@@ -106,15 +204,26 @@ static void sunxi_disp2_close(struct sunxi_disp *sunxi_disp)
 
 	disp->video_config.enable = 0;
 	ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args);
+	sunxi_disp_layer_put(disp->video);
 
-	if (disp->osd_config.enable)
+	if (disp->osd)
 	{
 		disp->osd_config.enable = 0;
 		args[1] = (unsigned long)(&disp->osd_config);
 		ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args);
+		sunxi_disp_layer_put(disp->osd);
 	}
 
-	close(disp->fd);
+	int i;
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+	{
+		disp->extra_config[i].enable = 0;
+		args[1] = (unsigned long)(&disp->extra_config[i]);
+		ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args);
+		sunxi_disp_layer_put(disp->extra[i]);
+	}
+
+	sunxi_vsync_close(disp->vsync);
 	free(sunxi_disp);
 }
 
@@ -150,7 +259,9 @@ static void clip(disp_rect *src, disp_rect *scn, unsigned int screen_width)
 static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
 {
 	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+	int i;
 
+	const surface_layout_t *layout = &surface->video_layout;
 	disp_rect src = { .x = surface->video_src_rect.x0, .y = surface->video_src_rect.y0,
 			  .width = surface->video_src_rect.x1 - surface->video_src_rect.x0,
 			  .height = surface->video_src_rect.y1 - surface->video_src_rect.y0 };
@@ -160,8 +271,7 @@ static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 
 	clip (&src, &scn, disp->screen_width);
 
-	unsigned long args[4] = { 0, (unsigned long)(&disp->video_config), 1, 0 };
-	switch (surface->vs->source_format)
+	switch (layout->format)
 	{
 	case VDP_YCBCR_FORMAT_YUYV:
 		disp->video_config.info.fb.format = DISP_FORMAT_YUV422_I_YUYV;
@@ -179,19 +289,26 @@ static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 		break;
 	}
 
-	disp->video_config.info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->yuv->data);
-	disp->video_config.info.fb.addr[1] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size;
-	disp->video_config.info.fb.addr[2] = cedrus_mem_get_phys_addr(surface->yuv->data) + surface->vs->luma_size + surface->vs->chroma_size / 2;
-
-	disp->video_config.info.fb.size[0].width = surface->vs->width;
-	disp->video_config.info.fb.size[0].height = surface->vs->height;
-	disp->video_config.info.fb.align[0] = 32;
-	disp->video_config.info.fb.size[1].width = surface->vs->width / 2;
-	disp->video_config.info.fb.size[1].height = surface->vs->height / 2;
-	disp->video_config.info.fb.align[1] = 16;
-	disp->video_config.info.fb.size[2].width = surface->vs->width / 2;
-	disp->video_config.info.fb.size[2].height = surface->vs->height / 2;
-	disp->video_config.info.fb.align[2] = 16;
+	for (i = 0; i < 3; i++)
+	{
+		if (i < layout->num_planes)
+		{
+			const plane_layout_t *plane = &layout->plane[i];
+
+			// the pitch is the plane width aligned, so pass its largest power of two
+			disp->video_config.info.fb.addr[i] = cedrus_mem_get_phys_addr(surface->yuv->data) + plane->offset;
+			disp->video_config.info.fb.size[i].width = plane->width;
+			disp->video_config.info.fb.size[i].height = plane->height;
+			disp->video_config.info.fb.align[i] = plane->pitch & -plane->pitch;
+		}
+		else
+		{
+			disp->video_config.info.fb.addr[i] = 0;
+			disp->video_config.info.fb.size[i].width = 0;
+			disp->video_config.info.fb.size[i].height = 0;
+			disp->video_config.info.fb.align[i] = 0;
+		}
+	}
 	disp->video_config.info.fb.crop.x = (unsigned long long)(src.x) << 32;
 	disp->video_config.info.fb.crop.y = (unsigned long long)(src.y) << 32;
 	disp->video_config.info.fb.crop.width = (unsigned long long)(src.width) << 32;
@@ -199,9 +316,6 @@ static int sunxi_disp2_set_video_layer(struct sunxi_disp *sunxi_disp, int x, int
 	disp->video_config.info.screen_win = scn;
 	disp->video_config.enable = 1;
 
-	if (ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args))
-		return -EINVAL;
-
 	return 0;
 }
 
@@ -209,52 +323,50 @@ static void sunxi_disp2_close_video_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
 
-	unsigned long args[4] = { 0, (unsigned long)(&disp->video_config), 1, 0 };
-
 	disp->video_config.enable = 0;
-
-	ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args);
 }
 
-static int sunxi_disp2_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+static void set_rgba_config(disp_layer_config *config, int x, int y, int width, int height, unsigned int screen_width,
+                            rgba_surface_t *rgba, const VdpRect *src_rect, const VdpRect *dst_rect)
 {
-	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
-
-	unsigned long args[4] = { 0, (unsigned long)(&disp->osd_config), 1, 0 };
+	disp_rect src = { .x = src_rect->x0, .y = src_rect->y0,
+			  .width = src_rect->x1 - src_rect->x0,
+			  .height = src_rect->y1 - src_rect->y0 };
+	disp_rect scn = { .x = x + dst_rect->x0, .y = y + dst_rect->y0,
+			  .width = min_nz(width, dst_rect->x1) - dst_rect->x0,
+			  .height = min_nz(height, dst_rect->y1) - dst_rect->y0 };
 
-	disp_rect src = { .x = surface->rgba.dirty.x0, .y = surface->rgba.dirty.y0,
-			  .width = surface->rgba.dirty.x1 - surface->rgba.dirty.x0,
-			  .height = surface->rgba.dirty.y1 - surface->rgba.dirty.y0 };
-	disp_rect scn = { .x = x + surface->rgba.dirty.x0, .y = y + surface->rgba.dirty.y0,
-			  .width = min_nz(width, surface->rgba.dirty.x1) - surface->rgba.dirty.x0,
-			  .height = min_nz(height, surface->rgba.dirty.y1) - surface->rgba.dirty.y0 };
+	clip (&src, &scn, screen_width);
 
-	clip (&src, &scn, disp->screen_width);
-
-	switch (surface->rgba.format)
+	switch (rgba->format)
 	{
 	case VDP_RGBA_FORMAT_R8G8B8A8:
-		disp->osd_config.info.fb.format = DISP_FORMAT_ABGR_8888;
+		config->info.fb.format = DISP_FORMAT_ABGR_8888;
 		break;
 	case VDP_RGBA_FORMAT_B8G8R8A8:
 	default:
-		disp->osd_config.info.fb.format = DISP_FORMAT_ARGB_8888;
+		config->info.fb.format = DISP_FORMAT_ARGB_8888;
 		break;
 	}
 
-	disp->osd_config.info.fb.addr[0] = cedrus_mem_get_phys_addr(surface->rgba.data);
-	disp->osd_config.info.fb.size[0].width = surface->rgba.width;
-	disp->osd_config.info.fb.size[0].height = surface->rgba.height;
-	disp->osd_config.info.fb.align[0] = 1;
-	disp->osd_config.info.fb.crop.x = (unsigned long long)(src.x) << 32;
-	disp->osd_config.info.fb.crop.y = (unsigned long long)(src.y) << 32;
-	disp->osd_config.info.fb.crop.width = (unsigned long long)(src.width) << 32;
-	disp->osd_config.info.fb.crop.height = (unsigned long long)(src.height) << 32;
-	disp->osd_config.info.screen_win = scn;
-	disp->osd_config.enable = 1;
+	config->info.fb.addr[0] = cedrus_mem_get_phys_addr(rgba->data);
+	config->info.fb.size[0].width = rgba->width;
+	config->info.fb.size[0].height = rgba->height;
+	config->info.fb.align[0] = 1;
+	config->info.fb.crop.x = (unsigned long long)(src.x) << 32;
+	config->info.fb.crop.y = (unsigned long long)(src.y) << 32;
+	config->info.fb.crop.width = (unsigned long long)(src.width) << 32;
+	config->info.fb.crop.height = (unsigned long long)(src.height) << 32;
+	config->info.screen_win = scn;
+	config->enable = 1;
+}
 
-	if (ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args))
-		return -EINVAL;
+static int sunxi_disp2_set_osd_layer(struct sunxi_disp *sunxi_disp, int x, int y, int width, int height, output_surface_ctx_t *surface)
+{
+	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+
+	set_rgba_config(&disp->osd_config, x, y, width, height, disp->screen_width,
+			&surface->rgba, &surface->rgba.dirty.bounds, &surface->rgba.dirty.bounds);
 
 	return 0;
 }
@@ -263,9 +375,68 @@ static void sunxi_disp2_close_osd_layer(struct sunxi_disp *sunxi_disp)
 {
 	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
 
-	unsigned long args[4] = { 0, (unsigned long)(&disp->osd_config), 1, 0 };
-
 	disp->osd_config.enable = 0;
+}
 
-	ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args);
+static int sunxi_disp2_set_extra_layer(struct sunxi_disp *sunxi_disp, int index, int x, int y, int width, int height, mixer_layer_t *layer)
+{
+	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+	VdpRect src = { 0, 0, layer->rgba.width, layer->rgba.height };
+
+	set_rgba_config(&disp->extra_config[index], x, y, width, height, disp->screen_width,
+			&layer->rgba, &src, &layer->dst);
+
+	return 0;
+}
+
+static void sunxi_disp2_close_extra_layer(struct sunxi_disp *sunxi_disp, int index)
+{
+	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+
+	disp->extra_config[index].enable = 0;
+}
+
+static int sunxi_disp2_wait_for_vsync(struct sunxi_disp *sunxi_disp, uint64_t *timestamp)
+{
+	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+
+	return sunxi_vsync_wait(disp->vsync, timestamp);
+}
+
+/*
+ * The layer functions only update the configs, all layers that changed
+ * since the last commit are sent in a single ioctl here, so that they
+ * take effect in the same frame. There is no cheaper ioctl than a full
+ * config, but none at all is needed if nothing changed.
+ */
+static int sunxi_disp2_commit(struct sunxi_disp *sunxi_disp)
+{
+	struct sunxi_disp2_private *disp = (struct sunxi_disp2_private *)sunxi_disp;
+	disp_layer_config configs[2 + SUNXI_DISP_MAX_EXTRA_LAYERS];
+	unsigned long count = 0;
+	int i;
+
+	if (memcmp(&disp->video_config, &disp->video_committed, sizeof(disp_layer_config)) != 0)
+		configs[count++] = disp->video_config;
+
+	if (memcmp(&disp->osd_config, &disp->osd_committed, sizeof(disp_layer_config)) != 0)
+		configs[count++] = disp->osd_config;
+
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+		if (memcmp(&disp->extra_config[i], &disp->extra_committed[i], sizeof(disp_layer_config)) != 0)
+			configs[count++] = disp->extra_config[i];
+
+	if (count == 0)
+		return 0;
+
+	unsigned long args[4] = { 0, (unsigned long)configs, count, 0 };
+	if (ioctl(disp->fd, DISP_LAYER_SET_CONFIG, args))
+		return -EINVAL;
+
+	disp->video_committed = disp->video_config;
+	disp->osd_committed = disp->osd_config;
+	for (i = 0; i < disp->pub.num_extra_layers; i++)
+		disp->extra_committed[i] = disp->extra_config[i];
+
+	return 0;
 }
@@ -0,0 +1,137 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include "sunxi_disp.h"
+
+struct sunxi_disp_device *sunxi_disp_probe(int osd_enabled)
+{
+	struct sunxi_disp_device *device = sunxi_disp_open(osd_enabled);
+
+	if (!device)
+		device = sunxi_disp2_open(osd_enabled);
+
+	if (!device)
+		device = sunxi_disp1_5_open(osd_enabled);
+
+	return device;
+}
+
+int sunxi_disp_layer_add(struct sunxi_disp_device *device, int id, int scaler)
+{
+	if (device->num_layers >= SUNXI_DISP_MAX_LAYERS)
+		return 0;
+
+	struct sunxi_disp_layer *layer = &device->layers[device->num_layers++];
+	layer->id = id;
+	layer->scaler = scaler;
+	layer->in_use = 0;
+
+	return 1;
+}
+
+struct sunxi_disp_layer *sunxi_disp_layer_get(struct sunxi_disp_device *device, int scaler)
+{
+	struct sunxi_disp_layer *layer = NULL;
+	unsigned int zorder = 0;
+	int i;
+
+	for (i = 0; i < device->num_layers; i++)
+	{
+		if (device->layers[i].in_use)
+		{
+			if (device->layers[i].zorder > zorder)
+				zorder = device->layers[i].zorder;
+		}
+		else if (!layer && device->layers[i].scaler == scaler)
+			layer = &device->layers[i];
+	}
+
+	if (!layer)
+		return NULL;
+
+	layer->in_use = 1;
+	layer->zorder = zorder + 1;
+
+	return layer;
+}
+
+void sunxi_disp_layer_put(struct sunxi_disp_layer *layer)
+{
+	if (layer)
+		layer->in_use = 0;
+}
+
+// reorders layers bottom to top, within the zorders they already have
+static void restack(struct sunxi_disp_layer *const *layers, int count)
+{
+	unsigned int zorders[SUNXI_DISP_MAX_LAYERS];
+	int i, j;
+
+	for (i = 0; i < count; i++)
+	{
+		unsigned int zorder = layers[i]->zorder;
+
+		for (j = i; j > 0 && zorders[j - 1] > zorder; j--)
+			zorders[j] = zorders[j - 1];
+		zorders[j] = zorder;
+	}
+
+	for (i = 0; i < count; i++)
+		layers[i]->zorder = zorders[i];
+}
+
+/*
+ * Takes what is left of the non-scaler layers as extra layers of a
+ * target and stacks them around its video and OSD layer: background
+ * if the device has one, video, mixer layers, OSD.
+ */
+int sunxi_disp_layer_get_extra(struct sunxi_disp_device *device, struct sunxi_disp_layer *video,
+                               struct sunxi_disp_layer *osd, struct sunxi_disp_layer **extra)
+{
+	struct sunxi_disp_layer *stack[SUNXI_DISP_MAX_EXTRA_LAYERS + 2];
+	int count, i;
+
+	for (count = 0; count < SUNXI_DISP_MAX_EXTRA_LAYERS; count++)
+	{
+		extra[count] = sunxi_disp_layer_get(device, 0);
+		if (!extra[count])
+			break;
+	}
+
+	if (count == 0)
+		return 0;
+
+	if (device->background_layer)
+	{
+		stack[0] = extra[0];
+		stack[1] = video;
+	}
+	else
+	{
+		stack[0] = video;
+		stack[1] = extra[0];
+	}
+	for (i = 1; i < count; i++)
+		stack[i + 1] = extra[i];
+	stack[count + 1] = osd;
+
+	restack(stack, count + 2);
+
+	return count;
+}
@@ -0,0 +1,258 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fb.h>
+#include <linux/netlink.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "sunxi_disp.h"
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, uint32_t)
+#endif
+
+/*
+ * Once enabled with the VSYNC_EVENT_EN ioctl, the disp driver sends a
+ * "VSYNC0=<monotonic ns>" uevent per vblank. Kernels without it still
+ * have FBIO_WAITFORVSYNC on the framebuffer, which only tells when.
+ */
+struct sunxi_vsync
+{
+	struct sunxi_disp_device *device;
+	unsigned long event_cmd;
+	int uevent_fd;
+	int fb_fd;
+	uint64_t last, period;
+	int lost;
+};
+
+static uint64_t monotonic_time(void)
+{
+	struct timespec tp;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &tp) == -1)
+		return 0;
+
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+static int open_uevent_socket(void)
+{
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = 1 };
+
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (fd == -1)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+struct sunxi_vsync *sunxi_vsync_open(struct sunxi_disp_device *device, unsigned long event_cmd)
+{
+	struct sunxi_vsync *vsync = calloc(1, sizeof(*vsync));
+	if (!vsync)
+		return NULL;
+
+	vsync->device = device;
+	vsync->uevent_fd = -1;
+	vsync->fb_fd = -1;
+
+	// events are switched per device, on by the first target, off by the last
+	if (event_cmd)
+	{
+		unsigned long args[4] = { 0, 1, 0, 0 };
+		if (device->vsync_users++ == 0)
+			device->vsync_events = ioctl(device->fd, event_cmd, args) == 0;
+
+		vsync->event_cmd = event_cmd;
+		if (device->vsync_events)
+			vsync->uevent_fd = open_uevent_socket();
+	}
+
+	if (vsync->uevent_fd == -1)
+		vsync->fb_fd = open("/dev/fb0", O_RDWR | O_CLOEXEC);
+
+	if (vsync->uevent_fd == -1 && vsync->fb_fd == -1)
+	{
+		sunxi_vsync_close(vsync);
+		return NULL;
+	}
+
+	return vsync;
+}
+
+void sunxi_vsync_close(struct sunxi_vsync *vsync)
+{
+	if (!vsync)
+		return;
+
+	if (vsync->event_cmd && --vsync->device->vsync_users == 0 && vsync->device->vsync_events)
+	{
+		unsigned long args[4] = { 0, 0, 0, 0 };
+		ioctl(vsync->device->fd, vsync->event_cmd, args);
+		vsync->device->vsync_events = 0;
+	}
+
+	if (vsync->uevent_fd != -1)
+		close(vsync->uevent_fd);
+	if (vsync->fb_fd != -1)
+		close(vsync->fb_fd);
+
+	free(vsync);
+}
+
+/*
+ * Returns 1 and the timestamp for a vsync message, 0 for other
+ * messages and -1 if there is nothing to read.
+ */
+static int read_uevent(struct sunxi_vsync *vsync, int flags, uint64_t *timestamp)
+{
+	char buf[1024];
+	ssize_t len;
+
+	// the socket overflowed and messages got lost, just read on
+	do
+		len = recv(vsync->uevent_fd, buf, sizeof(buf) - 1, flags);
+	while (len == -1 && errno == ENOBUFS);
+
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	// the message is a list of NUL terminated KEY=value strings
+	char *s;
+	for (s = buf; s < buf + len; s += strlen(s) + 1)
+	{
+		if (strncmp(s, "VSYNC0=", 7) == 0)
+		{
+			*timestamp = strtoull(s + 7, NULL, 10);
+
+			// shortest interval seen, missed events only make it longer
+			if (vsync->last && *timestamp > vsync->last &&
+			    (!vsync->period || *timestamp - vsync->last < vsync->period))
+				vsync->period = *timestamp - vsync->last;
+			vsync->last = *timestamp;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int wait_uevent(struct sunxi_vsync *vsync, uint64_t *timestamp)
+{
+	struct pollfd pfd = { .fd = vsync->uevent_fd, .events = POLLIN };
+	uint64_t newest = 0, ts;
+	int ret;
+
+	/*
+	 * Events keep coming while nobody waits for them. Drop the queued
+	 * ones and only take the newest, if the vblank it reports has just
+	 * happened.
+	 */
+	while ((ret = read_uevent(vsync, MSG_DONTWAIT, &ts)) >= 0)
+		if (ret == 1)
+			newest = ts;
+
+	if (newest)
+		vsync->lost = 0;
+
+	if (newest && vsync->period && newest + vsync->period >= monotonic_time())
+	{
+		*timestamp = newest;
+		return 0;
+	}
+
+	/*
+	 * Once events stopped, vblanks are predicted from the last one and
+	 * the period, while still listening for events to come back.
+	 */
+	uint64_t predicted = 0;
+	if (vsync->lost && vsync->period)
+	{
+		uint64_t now = monotonic_time();
+		predicted = vsync->last + ((now - vsync->last) / vsync->period + 1) * vsync->period;
+	}
+
+	for (;;)
+	{
+		// give up after a few frames, the display might be off
+		int timeout = 100;
+		if (predicted)
+		{
+			uint64_t now = monotonic_time();
+			if (now >= predicted)
+			{
+				*timestamp = predicted;
+				return 0;
+			}
+			timeout = (predicted - now + 999999) / 1000000;
+		}
+
+		if (poll(&pfd, 1, timeout) != 1)
+		{
+			if (predicted)
+				continue;
+
+			vsync->lost = 1;
+			return -1;
+		}
+
+		ret = read_uevent(vsync, 0, &ts);
+		if (ret < 0)
+			return -1;
+
+		if (ret == 1)
+		{
+			vsync->lost = 0;
+			*timestamp = ts;
+			return 0;
+		}
+	}
+}
+
+int sunxi_vsync_wait(struct sunxi_vsync *vsync, uint64_t *timestamp)
+{
+	if (!vsync)
+		return -1;
+
+	if (vsync->uevent_fd != -1)
+		return wait_uevent(vsync, timestamp);
+
+	uint32_t crtc = 0;
+	if (ioctl(vsync->fb_fd, FBIO_WAITFORVSYNC, &crtc) != 0)
+		return -1;
+
+	*timestamp = monotonic_time();
+	return 0;
+}
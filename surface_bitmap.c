@@ -42,7 +42,7 @@ VdpStatus vdp_bitmap_surface_create(VdpDevice device,
 
 	out->frequently_accessed = frequently_accessed;
 
-	ret = rgba_create(&out->rgba, dev, width, height, rgba_format);
+	ret = rgba_create(&out->rgba, dev, width, height, rgba_format, 0);
 	if (ret != VDP_STATUS_OK)
 	{
 		handle_destroy(*surface);
@@ -99,9 +99,7 @@ VdpStatus vdp_bitmap_surface_put_bits_native(VdpBitmapSurface surface,
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	rgba_put_bits_native(&out->rgba, source_data, source_pitches, destination_rect);
-
-	return VDP_STATUS_OK;
+	return rgba_put_bits_native(&out->rgba, source_data, source_pitches, destination_rect);
 }
 
 VdpStatus vdp_bitmap_surface_query_capabilities(VdpDevice device,
@@ -42,7 +42,7 @@ VdpStatus vdp_output_surface_create(VdpDevice device,
 	out->contrast = 1.0;
 	out->saturation = 1.0;
 
-	ret = rgba_create(&out->rgba, dev, width, height, rgba_format);
+	ret = rgba_create(&out->rgba, dev, width, height, rgba_format, 1);
 	if (ret != VDP_STATUS_OK)
 	{
 		handle_destroy(*surface);
@@ -58,11 +58,18 @@ VdpStatus vdp_output_surface_destroy(VdpOutputSurface surface)
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	presentation_queue_release_surface(out);
 	rgba_destroy(&out->rgba);
 
 	if (out->yuv)
 		yuv_unref(out->yuv);
 
+	int i, j;
+	for (i = 0; i < SUNXI_DISP_MAX_EXTRA_LAYERS; i++)
+		for (j = 0; j < MIXER_LAYER_COPIES; j++)
+			if (out->layer_copies[i][j])
+				mixer_layer_unref(out->layer_copies[i][j]);
+
 	handle_destroy(surface);
 
 	return VDP_STATUS_OK;
@@ -98,9 +105,10 @@ VdpStatus vdp_output_surface_get_bits_native(VdpOutputSurface surface,
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	if (!destination_data || !destination_pitches)
+		return VDP_STATUS_INVALID_POINTER;
 
-
-	return VDP_STATUS_ERROR;
+	return rgba_get_bits_native(&out->rgba, source_rect, destination_data, destination_pitches);
 }
 
 VdpStatus vdp_output_surface_put_bits_native(VdpOutputSurface surface,
@@ -142,7 +150,11 @@ VdpStatus vdp_output_surface_put_bits_y_cb_cr(VdpOutputSurface surface,
 	if (!out)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	return VDP_STATUS_ERROR;
+	if (!source_data || !source_pitches)
+		return VDP_STATUS_INVALID_POINTER;
+
+	return rgba_put_bits_y_cb_cr(&out->rgba, source_ycbcr_format, source_data, source_pitches,
+				     destination_rect, csc_matrix);
 }
 
 VdpStatus vdp_output_surface_render_output_surface(VdpOutputSurface destination_surface,
@@ -212,7 +224,9 @@ VdpStatus vdp_output_surface_query_get_put_bits_native_capabilities(VdpDevice de
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*is_supported = VDP_FALSE;
+	// without OSD the surfaces have no memory to read back from
+	*is_supported = dev->osd_enabled &&
+			(surface_rgba_format == VDP_RGBA_FORMAT_R8G8B8A8 || surface_rgba_format == VDP_RGBA_FORMAT_B8G8R8A8);
 
 	return VDP_STATUS_OK;
 }
@@ -230,7 +244,13 @@ VdpStatus vdp_output_surface_query_put_bits_indexed_capabilities(VdpDevice devic
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*is_supported = VDP_FALSE;
+	*is_supported = (surface_rgba_format == VDP_RGBA_FORMAT_B8G8R8A8 ||
+			 surface_rgba_format == VDP_RGBA_FORMAT_R8G8B8A8) &&
+			color_table_format == VDP_COLOR_TABLE_FORMAT_B8G8R8X8 &&
+			(bits_indexed_format == VDP_INDEXED_FORMAT_I8A8 ||
+			 bits_indexed_format == VDP_INDEXED_FORMAT_A8I8 ||
+			 bits_indexed_format == VDP_INDEXED_FORMAT_I4A4 ||
+			 bits_indexed_format == VDP_INDEXED_FORMAT_A4I4);
 
 	return VDP_STATUS_OK;
 }
@@ -247,7 +267,14 @@ VdpStatus vdp_output_surface_query_put_bits_y_cb_cr_capabilities(VdpDevice devic
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*is_supported = VDP_FALSE;
+	*is_supported = (surface_rgba_format == VDP_RGBA_FORMAT_B8G8R8A8 ||
+			 surface_rgba_format == VDP_RGBA_FORMAT_R8G8B8A8) &&
+			(bits_ycbcr_format == VDP_YCBCR_FORMAT_YV12 ||
+			 bits_ycbcr_format == VDP_YCBCR_FORMAT_NV12 ||
+			 bits_ycbcr_format == VDP_YCBCR_FORMAT_YUYV ||
+			 bits_ycbcr_format == VDP_YCBCR_FORMAT_UYVY ||
+			 bits_ycbcr_format == VDP_YCBCR_FORMAT_Y8U8V8A8 ||
+			 bits_ycbcr_format == VDP_YCBCR_FORMAT_V8U8Y8A8);
 
 	return VDP_STATUS_OK;
 }
@@ -21,6 +21,8 @@
 #include <cedrus/cedrus.h>
 #include "vdpau_private.h"
 #include "tiled_yuv.h"
+#include "thread_pool.h"
+#include "yuv_convert.h"
 
 void yuv_unref(yuv_data_t *yuv)
 {
@@ -46,7 +48,7 @@ static VdpStatus yuv_new(video_surface_ctx_t *video_surface)
 		return VDP_STATUS_RESOURCES;
 
 	video_surface->yuv->ref_count = 1;
-	video_surface->yuv->data = cedrus_mem_alloc(video_surface->device->cedrus, video_surface->luma_size + video_surface->chroma_size);
+	video_surface->yuv->data = cedrus_mem_alloc(video_surface->device->cedrus, video_surface->alloc_size);
 
 	if (!(video_surface->yuv->data))
 	{
@@ -68,6 +70,119 @@ VdpStatus yuv_prepare(video_surface_ctx_t *video_surface)
 	return VDP_STATUS_OK;
 }
 
+static void layout_init(surface_layout_t *layout, VdpYCbCrFormat format,
+                        uint32_t width, uint32_t height)
+{
+	uint32_t luma_pitch = ALIGN(width, 32);
+	uint32_t luma_height = ALIGN(height, 32);
+
+	memset(layout, 0, sizeof(*layout));
+	layout->format = format;
+
+	switch (format)
+	{
+	case VDP_YCBCR_FORMAT_YUYV:
+	case VDP_YCBCR_FORMAT_UYVY:
+		layout->num_planes = 1;
+		layout->plane[0].pitch = 2 * luma_pitch;
+		layout->plane[0].width = luma_pitch;
+		layout->plane[0].height = height;
+		break;
+
+	case VDP_YCBCR_FORMAT_Y8U8V8A8:
+	case VDP_YCBCR_FORMAT_V8U8Y8A8:
+		layout->num_planes = 1;
+		layout->plane[0].pitch = 4 * luma_pitch;
+		layout->plane[0].width = luma_pitch;
+		layout->plane[0].height = height;
+		break;
+
+	case INTERNAL_YCBCR_FORMAT:
+		// 32x32 tiles, chroma needs full tile rows too
+		layout->num_planes = 2;
+		layout->plane[0].pitch = luma_pitch;
+		layout->plane[0].width = luma_pitch;
+		layout->plane[0].height = luma_height;
+		layout->plane[1].offset = luma_pitch * luma_height;
+		layout->plane[1].pitch = luma_pitch;
+		layout->plane[1].width = luma_pitch / 2;
+		layout->plane[1].height = ALIGN(height / 2, 32);
+		break;
+
+	case VDP_YCBCR_FORMAT_NV12:
+		layout->num_planes = 2;
+		layout->plane[0].pitch = luma_pitch;
+		layout->plane[0].width = luma_pitch;
+		layout->plane[0].height = luma_height;
+		layout->plane[1].offset = luma_pitch * luma_height;
+		layout->plane[1].pitch = luma_pitch;
+		layout->plane[1].width = luma_pitch / 2;
+		layout->plane[1].height = luma_height / 2;
+		break;
+
+	case VDP_YCBCR_FORMAT_YV12:
+	default:
+		layout->num_planes = 3;
+		layout->plane[0].pitch = luma_pitch;
+		layout->plane[0].width = luma_pitch;
+		layout->plane[0].height = luma_height;
+		layout->plane[1].offset = luma_pitch * luma_height;
+		layout->plane[1].pitch = ALIGN(DIV_ROUND_UP(width, 2), 16);
+		layout->plane[1].width = layout->plane[1].pitch;
+		layout->plane[1].height = luma_height / 2;
+		layout->plane[2] = layout->plane[1];
+		layout->plane[2].offset = layout->plane[1].offset + layout->plane[1].pitch * layout->plane[1].height;
+		break;
+	}
+
+	plane_layout_t *last = &layout->plane[layout->num_planes - 1];
+	layout->size = last->offset + last->pitch * last->height;
+}
+
+void video_surface_set_format(video_surface_ctx_t *video_surface, VdpYCbCrFormat format)
+{
+	if (video_surface->layout.format != format)
+		layout_init(&video_surface->layout, format, video_surface->width, video_surface->height);
+}
+
+/*
+ * Works out what the display scans out of the output surface's yuv data,
+ * so the flip thread never has to look at the video surface, which may be
+ * destroyed or get a new format by then. A single field is shown by
+ * skipping every other line, which gives bob without copying anything.
+ */
+void video_surface_scanout(video_surface_ctx_t *vs, VdpVideoMixerPictureStructure field, output_surface_ctx_t *os)
+{
+	surface_layout_t *layout = &os->video_layout;
+	int i;
+
+	*layout = vs->layout;
+	os->video_height = vs->height;
+
+	if (field == VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME)
+		return;
+
+	// tiles keep lines of both fields together
+	if (layout->format == INTERNAL_YCBCR_FORMAT)
+	{
+		VDPAU_DBG_ONCE("Field output of tiled surfaces unsupported");
+		return;
+	}
+
+	for (i = 0; i < layout->num_planes; i++)
+	{
+		if (field == VDP_VIDEO_MIXER_PICTURE_STRUCTURE_BOTTOM_FIELD)
+			layout->plane[i].offset += layout->plane[i].pitch;
+		layout->plane[i].pitch *= 2;
+		layout->plane[i].width *= 2;
+		layout->plane[i].height /= 2;
+	}
+
+	os->video_src_rect.y0 /= 2;
+	os->video_src_rect.y1 /= 2;
+	os->video_height /= 2;
+}
+
 VdpStatus vdp_video_surface_create(VdpDevice device,
                                    VdpChromaType chroma_type,
                                    uint32_t width,
@@ -93,23 +208,37 @@ VdpStatus vdp_video_surface_create(VdpDevice device,
 	vs->height = height;
 	vs->chroma_type = chroma_type;
 
-	vs->luma_size = ALIGN(width, 32) * ALIGN(height, 32);
+	/*
+	 * The buffer has to fit every format the surface can hold, the first
+	 * one is what the surface starts with (and the decoders output).
+	 */
+	VdpYCbCrFormat formats[3];
+	unsigned int i, num_formats = 0;
 	switch (chroma_type)
 	{
 	case VDP_CHROMA_TYPE_444:
-		vs->chroma_size = vs->luma_size * 2;
+		formats[num_formats++] = VDP_YCBCR_FORMAT_Y8U8V8A8;
 		break;
 	case VDP_CHROMA_TYPE_422:
-		vs->chroma_size = vs->luma_size;
+		formats[num_formats++] = VDP_YCBCR_FORMAT_YUYV;
 		break;
 	case VDP_CHROMA_TYPE_420:
-		vs->chroma_size = ALIGN(vs->width, 32) * ALIGN(vs->height / 2, 32);
+		if (cedrus_get_ve_version(dev->cedrus) < 0x1680)
+			formats[num_formats++] = INTERNAL_YCBCR_FORMAT;
+		formats[num_formats++] = VDP_YCBCR_FORMAT_YV12;
+		formats[num_formats++] = VDP_YCBCR_FORMAT_NV12;
 		break;
 	default:
 		handle_destroy(*surface);
 		return VDP_STATUS_INVALID_CHROMA_TYPE;
 	}
 
+	for (i = num_formats; i > 0; i--)
+	{
+		layout_init(&vs->layout, formats[i - 1], width, height);
+		vs->alloc_size = max(vs->alloc_size, vs->layout.size);
+	}
+
 	VdpStatus ret = yuv_new(vs);
 	if (ret != VDP_STATUS_OK)
 	{
@@ -126,6 +255,10 @@ VdpStatus vdp_video_surface_destroy(VdpVideoSurface surface)
 	if (!vs)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	// the mapping ends with the surface, there is nothing left to flush for
+	if (vs->mapped)
+		VDPAU_DBG("Destroying mapped video surface");
+
 	if (vs->decoder_private_free)
 		vs->decoder_private_free(vs);
 
@@ -157,6 +290,124 @@ VdpStatus vdp_video_surface_get_parameters(VdpVideoSurface surface,
 	return VDP_STATUS_OK;
 }
 
+// CPU view of the surface planes
+static void surface_planes(video_surface_ctx_t *vs, uint8_t *planes[3], uint32_t pitches[3])
+{
+	uint8_t *base = cedrus_mem_get_pointer(vs->yuv->data);
+	int i;
+
+	for (i = 0; i < vs->layout.num_planes; i++)
+	{
+		planes[i] = base + vs->layout.plane[i].offset;
+		pitches[i] = vs->layout.plane[i].pitch;
+	}
+}
+
+/*
+ * Clean everything up to the last line of picture data, one range
+ * since 32bit ARM can only flush whole buffers anyway.
+ */
+static void flush_planes(video_surface_ctx_t *vs)
+{
+	const plane_layout_t *last = &vs->layout.plane[vs->layout.num_planes - 1];
+	uint32_t lines = vs->layout.num_planes == 1 ? vs->height : DIV_ROUND_UP(vs->height, 2);
+
+	cache_flush_range(vs->yuv->data, 0, last->offset + last->pitch * min(lines, last->height));
+}
+
+// number of planes and minimum pitches of client side buffers, odd widths round chroma up
+static int check_pitches(VdpYCbCrFormat format, uint32_t width, uint32_t const *pitches)
+{
+	switch (format)
+	{
+	case VDP_YCBCR_FORMAT_YUYV:
+	case VDP_YCBCR_FORMAT_UYVY:
+		return pitches[0] >= 2 * ALIGN(width, 2);
+	case VDP_YCBCR_FORMAT_NV12:
+		return pitches[0] >= width && pitches[1] >= ALIGN(width, 2);
+	case VDP_YCBCR_FORMAT_YV12:
+		return pitches[0] >= width && pitches[1] >= DIV_ROUND_UP(width, 2) && pitches[2] >= DIV_ROUND_UP(width, 2);
+	default:
+		return 0;
+	}
+}
+
+#ifndef __aarch64__
+#define DETILE_MAX_JOBS (2 * (MAX_WORKER_THREADS + 1))
+
+struct detile_job
+{
+	void *src;
+	void *dst1, *dst2;
+	unsigned int dst_pitch;
+	unsigned int width, height;
+};
+
+struct detile_ctx
+{
+	unsigned int num_jobs;
+	struct detile_job jobs[DETILE_MAX_JOBS];
+};
+
+static void detile_job_run(void *arg, unsigned int index)
+{
+	struct detile_job *job = &((struct detile_ctx *)arg)->jobs[index];
+
+	if (job->dst2)
+		tiled_deinterleave_to_planar(job->src, job->dst1, job->dst2, job->dst_pitch, job->width, job->height);
+	else
+		tiled_to_planar(job->src, job->dst1, job->dst_pitch, job->width, job->height);
+}
+
+// split a tiled plane at tile row (32 lines) boundaries into up to num_parts jobs
+static void detile_add_jobs(struct detile_ctx *ctx, unsigned int num_parts,
+                            void *src, unsigned int src_pitch,
+                            void *dst1, void *dst2, unsigned int dst_pitch,
+                            unsigned int width, unsigned int height)
+{
+	unsigned int tile_rows = DIV_ROUND_UP(height, 32);
+	unsigned int rows_per_job = DIV_ROUND_UP(tile_rows, num_parts);
+	unsigned int row;
+
+	for (row = 0; row < tile_rows; row += rows_per_job)
+	{
+		struct detile_job *job = &ctx->jobs[ctx->num_jobs++];
+
+		job->src = src + row * src_pitch * 32;
+		job->dst1 = dst1 + row * 32 * dst_pitch;
+		job->dst2 = dst2 ? dst2 + row * 32 * dst_pitch : NULL;
+		job->dst_pitch = dst_pitch;
+		job->width = width;
+		job->height = min(rows_per_job * 32, height - row * 32);
+	}
+}
+
+/*
+ * Luma and chroma are detiled in parallel, each split into tile rows
+ * spread over the device's worker threads. chroma_dst2 selects
+ * deinterleaving the chroma into two planes.
+ */
+static void detile(video_surface_ctx_t *vs, void *luma_dst, unsigned int luma_pitch,
+                   void *chroma_dst1, void *chroma_dst2, unsigned int chroma_pitch)
+{
+	struct thread_pool *pool = vs->device->thread_pool;
+	unsigned int threads = thread_pool_size(pool);
+	struct detile_ctx ctx = { .num_jobs = 0 };
+	void *src = cedrus_mem_get_pointer(vs->yuv->data);
+
+	const plane_layout_t *luma = &vs->layout.plane[0], *chroma = &vs->layout.plane[1];
+
+	cache_flush_range(vs->yuv->data, 0, vs->layout.size);
+
+	detile_add_jobs(&ctx, threads, src, luma->pitch, luma_dst, NULL, luma_pitch,
+			vs->width, vs->height);
+	detile_add_jobs(&ctx, DIV_ROUND_UP(threads, 2), src + chroma->offset, chroma->pitch,
+			chroma_dst1, chroma_dst2, chroma_pitch, vs->width, vs->height / 2);
+
+	thread_pool_run(pool, detile_job_run, &ctx, ctx.num_jobs);
+}
+#endif
+
 VdpStatus vdp_video_surface_get_bits_y_cb_cr(VdpVideoSurface surface,
                                              VdpYCbCrFormat destination_ycbcr_format,
                                              void *const *destination_data,
@@ -166,62 +417,79 @@ VdpStatus vdp_video_surface_get_bits_y_cb_cr(VdpVideoSurface surface,
 	if (!vs)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	if (vs->chroma_type != VDP_CHROMA_TYPE_420)
-		return VDP_STATUS_INVALID_CHROMA_TYPE;
+	if (!destination_data || !destination_pitches)
+		return VDP_STATUS_INVALID_POINTER;
 
-	if (destination_pitches[0] < vs->width || destination_pitches[1] < vs->width / 2)
-		return VDP_STATUS_ERROR;
+	if (!check_pitches(destination_ycbcr_format, vs->width, destination_pitches))
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
 
-	if (vs->source_format == VDP_YCBCR_FORMAT_YV12 && destination_ycbcr_format == VDP_YCBCR_FORMAT_YV12)
+#ifndef __aarch64__
+	if (vs->layout.format == INTERNAL_YCBCR_FORMAT)
 	{
-		int i;
-		const uint8_t *src;
-		uint8_t *dst;
-
-		src = cedrus_mem_get_pointer(vs->yuv->data);
-		dst = destination_data[0];
-		for (i = 0; i < vs->height; i++)
-		{
-			memcpy(dst, src, vs->width);
-			src += ALIGN(vs->width, 32);
-			dst += destination_pitches[0];
-		}
-		src = cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size;
-		dst = destination_data[2];
-		for (i = 0; i < vs->height / 2; i++)
+		if (destination_ycbcr_format == VDP_YCBCR_FORMAT_NV12)
 		{
-			memcpy(dst, src, vs->width / 2);
-			src += ALIGN(vs->width / 2, 16);
-			dst += destination_pitches[2];
+			detile(vs, destination_data[0], destination_pitches[0], destination_data[1], NULL, destination_pitches[1]);
+			return VDP_STATUS_OK;
 		}
-		src = cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size + vs->chroma_size / 2;
-		dst = destination_data[1];
-		for (i = 0; i < vs->height / 2; i++)
+		else if (destination_ycbcr_format == VDP_YCBCR_FORMAT_YV12)
 		{
-			memcpy(dst, src, vs->width / 2);
-			src += ALIGN(vs->width / 2, 16);
-			dst += destination_pitches[1];
+			if (destination_pitches[2] != destination_pitches[1])
+				return VDP_STATUS_ERROR;
+			detile(vs, destination_data[0], destination_pitches[0], destination_data[2], destination_data[1], destination_pitches[1]);
+			return VDP_STATUS_OK;
 		}
-		return VDP_STATUS_OK;
+
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
 	}
-#ifndef __aarch64__
-	else if (vs->source_format == INTERNAL_YCBCR_FORMAT && destination_ycbcr_format == VDP_YCBCR_FORMAT_NV12)
+#endif
+
+	yuv_convert_func convert = yuv_get_converter(vs->layout.format, destination_ycbcr_format);
+	if (!convert)
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+
+	uint8_t *src[3];
+	uint32_t src_pitches[3];
+	surface_planes(vs, src, src_pitches);
+
+	// VDPAU's YV12 has Cr first
+	uint8_t *dst[3] = { destination_data[0], destination_data[1], destination_data[2] };
+	uint32_t dst_pitches[3] = { destination_pitches[0], destination_pitches[1], destination_pitches[2] };
+	if (destination_ycbcr_format == VDP_YCBCR_FORMAT_YV12)
 	{
-		tiled_to_planar(cedrus_mem_get_pointer(vs->yuv->data), destination_data[0], destination_pitches[0], vs->width, vs->height);
-		tiled_to_planar(cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size, destination_data[1], destination_pitches[1], vs->width, vs->height / 2);
-		return VDP_STATUS_OK;
+		dst[1] = destination_data[2];
+		dst[2] = destination_data[1];
+		dst_pitches[1] = destination_pitches[2];
+		dst_pitches[2] = destination_pitches[1];
 	}
-	else if (vs->source_format == INTERNAL_YCBCR_FORMAT && destination_ycbcr_format == VDP_YCBCR_FORMAT_YV12)
+
+	// the VE might have written this behind the CPU's back, drop stale cache lines first
+	cache_flush_range(vs->yuv->data, 0, vs->layout.size);
+
+	convert(dst, dst_pitches, (const uint8_t *const *)src, src_pitches, vs->width, vs->height);
+
+	return VDP_STATUS_OK;
+}
+
+// 4:2:2 input is stored as is on 4:2:2 surfaces, or subsampled to planar 4:2:0
+static VdpStatus put_bits_format(video_surface_ctx_t *vs, VdpYCbCrFormat format,
+                                 VdpYCbCrFormat *surface_format)
+{
+	switch (vs->chroma_type)
 	{
-		if (destination_pitches[2] != destination_pitches[1])
-			return VDP_STATUS_ERROR;
-		tiled_to_planar(cedrus_mem_get_pointer(vs->yuv->data), destination_data[0], destination_pitches[0], vs->width, vs->height);
-		tiled_deinterleave_to_planar(cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size, destination_data[2], destination_data[1], destination_pitches[1], vs->width, vs->height / 2);
+	case VDP_CHROMA_TYPE_420:
+		if (format == VDP_YCBCR_FORMAT_NV12)
+			*surface_format = VDP_YCBCR_FORMAT_NV12;
+		else
+			*surface_format = VDP_YCBCR_FORMAT_YV12;
+		return VDP_STATUS_OK;
+	case VDP_CHROMA_TYPE_422:
+		if (format != VDP_YCBCR_FORMAT_YUYV && format != VDP_YCBCR_FORMAT_UYVY)
+			return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+		*surface_format = format;
 		return VDP_STATUS_OK;
+	default:
+		return VDP_STATUS_INVALID_CHROMA_TYPE;
 	}
-#endif
-
-	return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
 }
 
 VdpStatus vdp_video_surface_put_bits_y_cb_cr(VdpVideoSurface surface,
@@ -229,85 +497,122 @@ VdpStatus vdp_video_surface_put_bits_y_cb_cr(VdpVideoSurface surface,
                                              void const *const *source_data,
                                              uint32_t const *source_pitches)
 {
-	int i;
-	const uint8_t *src;
-	uint8_t *dst;
+	VdpYCbCrFormat surface_format;
 	video_surface_ctx_t *vs = handle_get(surface);
 	if (!vs)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	VdpStatus ret = yuv_prepare(vs);
+	if (!source_data || !source_pitches)
+		return VDP_STATUS_INVALID_POINTER;
+
+	if (vs->mapped)
+		return VDP_STATUS_ERROR;
+
+	if (!check_pitches(source_ycbcr_format, vs->width, source_pitches))
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+
+	VdpStatus ret = put_bits_format(vs, source_ycbcr_format, &surface_format);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	yuv_convert_func convert = yuv_get_converter(source_ycbcr_format, surface_format);
+	if (!convert)
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+
+	ret = yuv_prepare(vs);
 	if (ret != VDP_STATUS_OK)
 		return ret;
 
-	vs->source_format = source_ycbcr_format;
+	video_surface_set_format(vs, surface_format);
+
+	uint8_t *dst[3];
+	uint32_t dst_pitches[3];
+	surface_planes(vs, dst, dst_pitches);
 
-	switch (source_ycbcr_format)
+	// VDPAU's YV12 has Cr first
+	const uint8_t *src[3] = { source_data[0], source_data[1], source_data[2] };
+	uint32_t src_pitches[3] = { source_pitches[0], source_pitches[1], source_pitches[2] };
+	if (source_ycbcr_format == VDP_YCBCR_FORMAT_YV12)
 	{
-	case VDP_YCBCR_FORMAT_YUYV:
-	case VDP_YCBCR_FORMAT_UYVY:
-		if (vs->chroma_type != VDP_CHROMA_TYPE_422)
-			return VDP_STATUS_INVALID_CHROMA_TYPE;
-		src = source_data[0];
-		dst = cedrus_mem_get_pointer(vs->yuv->data);
-		for (i = 0; i < vs->height; i++) {
-			memcpy(dst, src, 2*vs->width);
-			src += source_pitches[0];
-			dst += 2*vs->width;
-		}
-		break;
-	case VDP_YCBCR_FORMAT_Y8U8V8A8:
-	case VDP_YCBCR_FORMAT_V8U8Y8A8:
+		src[1] = source_data[2];
+		src[2] = source_data[1];
+		src_pitches[1] = source_pitches[2];
+		src_pitches[2] = source_pitches[1];
+	}
 
-		break;
+	convert(dst, dst_pitches, src, src_pitches, vs->width, vs->height);
 
-	case VDP_YCBCR_FORMAT_NV12:
-		if (vs->chroma_type != VDP_CHROMA_TYPE_420)
-			return VDP_STATUS_INVALID_CHROMA_TYPE;
-		src = source_data[0];
-		dst = cedrus_mem_get_pointer(vs->yuv->data);
-		for (i = 0; i < vs->height; i++) {
-			memcpy(dst, src, vs->width);
-			src += source_pitches[0];
-			dst += vs->width;
-		}
-		src = source_data[1];
-		dst = cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size;
-		for (i = 0; i < vs->height / 2; i++) {
-			memcpy(dst, src, vs->width);
-			src += source_pitches[1];
-			dst += vs->width;
-		}
-		break;
+	flush_planes(vs);
 
-	case VDP_YCBCR_FORMAT_YV12:
-		if (vs->chroma_type != VDP_CHROMA_TYPE_420)
-			return VDP_STATUS_INVALID_CHROMA_TYPE;
-		src = source_data[0];
-		dst = cedrus_mem_get_pointer(vs->yuv->data);
-		for (i = 0; i < vs->height; i++) {
-			memcpy(dst, src, vs->width);
-			src += source_pitches[0];
-			dst += vs->width;
-		}
-		src = source_data[2];
-		dst = cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size;
-		for (i = 0; i < vs->height / 2; i++) {
-			memcpy(dst, src, vs->width / 2);
-			src += source_pitches[1];
-			dst += vs->width / 2;
-		}
-		src = source_data[1];
-		dst = cedrus_mem_get_pointer(vs->yuv->data) + vs->luma_size + vs->chroma_size / 2;
-		for (i = 0; i < vs->height / 2; i++) {
-			memcpy(dst, src, vs->width / 2);
-			src += source_pitches[2];
-			dst += vs->width / 2;
-		}
-		break;
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_sunxi_video_surface_map(VdpVideoSurface surface,
+                                      VdpYCbCrFormat ycbcr_format,
+                                      void **data,
+                                      uint32_t *pitches)
+{
+	VdpYCbCrFormat surface_format;
+	video_surface_ctx_t *vs = handle_get(surface);
+	if (!vs)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (!data || !pitches)
+		return VDP_STATUS_INVALID_POINTER;
+
+	if (vs->mapped)
+		return VDP_STATUS_ERROR;
+
+	VdpStatus ret = put_bits_format(vs, ycbcr_format, &surface_format);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	// only formats stored as they are can be written directly
+	if (surface_format != ycbcr_format)
+		return VDP_STATUS_INVALID_Y_CB_CR_FORMAT;
+
+	ret = yuv_prepare(vs);
+	if (ret != VDP_STATUS_OK)
+		return ret;
+
+	video_surface_set_format(vs, surface_format);
+
+	uint8_t *planes[3];
+	uint32_t plane_pitches[3];
+	surface_planes(vs, planes, plane_pitches);
+
+	data[0] = planes[0];
+	pitches[0] = plane_pitches[0];
+	if (surface_format == VDP_YCBCR_FORMAT_NV12)
+	{
+		data[1] = planes[1];
+		pitches[1] = plane_pitches[1];
+	}
+	else if (surface_format == VDP_YCBCR_FORMAT_YV12)
+	{
+		// VDPAU's YV12 has Cr first
+		data[1] = planes[2];
+		data[2] = planes[1];
+		pitches[1] = plane_pitches[2];
+		pitches[2] = plane_pitches[1];
 	}
 
-	cedrus_mem_flush_cache(vs->yuv->data);
+	vs->mapped = 1;
+
+	return VDP_STATUS_OK;
+}
+
+VdpStatus vdp_sunxi_video_surface_unmap(VdpVideoSurface surface)
+{
+	video_surface_ctx_t *vs = handle_get(surface);
+	if (!vs)
+		return VDP_STATUS_INVALID_HANDLE;
+
+	if (!vs->mapped)
+		return VDP_STATUS_ERROR;
+
+	flush_planes(vs);
+	vs->mapped = 0;
 
 	return VDP_STATUS_OK;
 }
@@ -344,11 +649,24 @@ VdpStatus vdp_video_surface_query_get_put_bits_y_cb_cr_capabilities(VdpDevice de
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	if (surface_chroma_type == VDP_CHROMA_TYPE_420)
+	switch (surface_chroma_type)
+	{
+	case VDP_CHROMA_TYPE_420:
+		// tiled decoder output of older VEs can only be read back as NV12 or YV12
 		*is_supported = (bits_ycbcr_format == VDP_YCBCR_FORMAT_NV12) ||
-				(bits_ycbcr_format == VDP_YCBCR_FORMAT_YV12);
-	else
+				(bits_ycbcr_format == VDP_YCBCR_FORMAT_YV12) ||
+				(cedrus_get_ve_version(dev->cedrus) >= 0x1680 &&
+				 ((bits_ycbcr_format == VDP_YCBCR_FORMAT_YUYV) ||
+				  (bits_ycbcr_format == VDP_YCBCR_FORMAT_UYVY)));
+		break;
+	case VDP_CHROMA_TYPE_422:
+		*is_supported = (bits_ycbcr_format == VDP_YCBCR_FORMAT_YUYV) ||
+				(bits_ycbcr_format == VDP_YCBCR_FORMAT_UYVY);
+		break;
+	default:
 		*is_supported = VDP_FALSE;
+		break;
+	}
 
 	return VDP_STATUS_OK;
 }
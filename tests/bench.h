@@ -0,0 +1,88 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "../vdpau_private.h"
+#include "../thread_pool.h"
+
+static inline uint64_t bench_time(void)
+{
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+
+	return (uint64_t)tp.tv_sec * 1000000000ULL + (uint64_t)tp.tv_nsec;
+}
+
+// runs func once to warm up, then for about a second, returns ns per run
+static inline double bench_run(void (*func)(void *arg), void *arg)
+{
+	uint64_t start, elapsed;
+	unsigned int runs = 0;
+
+	func(arg);
+
+	start = bench_time();
+	do
+	{
+		func(arg);
+		runs++;
+		elapsed = bench_time() - start;
+	}
+	while (elapsed < 1000000000ULL);
+
+	return (double)elapsed / runs;
+}
+
+// worker threads the driver starts on this machine, as in device creation
+static inline unsigned int bench_worker_threads(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return cpus > 1 ? min(cpus - 1, MAX_WORKER_THREADS) : 0;
+}
+
+// just enough of a device for video surfaces, on tests/fake_cedrus.c
+static inline device_ctx_t *bench_device_create(VdpDevice *device, unsigned int threads)
+{
+	device_ctx_t *dev = handle_create(sizeof(*dev), device);
+	if (!dev)
+		return NULL;
+
+	dev->cedrus = cedrus_open();
+	dev->thread_pool = thread_pool_create(threads);
+
+	return dev;
+}
+
+static inline void bench_device_destroy(VdpDevice device)
+{
+	device_ctx_t *dev = handle_get(device);
+
+	thread_pool_destroy(dev->thread_pool);
+	cedrus_close(dev->cedrus);
+	handle_destroy(device);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Times the YCbCr to RGBA conversion behind output surface put_bits on
+ * 720p and 1080p frames, NEON where the compiler has it, C otherwise.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../yuv_convert.h"
+
+// BT.601, limited range
+static VdpCSCMatrix bt601 = {
+	{ 1.164f,  0.000f,  1.596f, -0.874f },
+	{ 1.164f, -0.392f, -0.813f,  0.532f },
+	{ 1.164f,  2.017f,  0.000f, -1.086f },
+};
+
+struct bench_ctx
+{
+	uint32_t width, height;
+	uint8_t *y, *cb, *cr, *a;
+	uint8_t *dst;
+	yuv_csc_t csc;
+};
+
+// the same rows are converted over and over, like put_bits after unpacking
+static void run(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+	uint32_t line;
+
+	for (line = 0; line < ctx->height; line++)
+		yuv_csc_row(ctx->dst + line * ctx->width * 4, ctx->y, ctx->cb, ctx->cr, ctx->a,
+		            ctx->width, &ctx->csc, 0);
+}
+
+int main(void)
+{
+	static const uint32_t sizes[][2] = { { 1280, 720 }, { 1920, 1080 } };
+	unsigned int i, x;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++)
+	{
+		struct bench_ctx ctx = { .width = sizes[i][0], .height = sizes[i][1] };
+
+		ctx.y = malloc(ctx.width * 4);
+		ctx.dst = malloc(ctx.width * ctx.height * 4);
+		if (!ctx.y || !ctx.dst)
+			return EXIT_FAILURE;
+
+		ctx.cb = ctx.y + ctx.width;
+		ctx.cr = ctx.y + 2 * ctx.width;
+		ctx.a = ctx.y + 3 * ctx.width;
+		for (x = 0; x < ctx.width; x++)
+		{
+			ctx.y[x] = 16 + x % 220;
+			ctx.cb[x] = 16 + (x / 2) % 225;
+			ctx.cr[x] = 240 - (x / 2) % 225;
+		}
+		memset(ctx.a, 0xff, ctx.width);
+		yuv_csc_init(&ctx.csc, &bt601);
+
+		double ns = bench_run(run, &ctx);
+		printf("csc %ux%u: %.2f ms/frame, %.1f Mpixel/s\n", ctx.width, ctx.height,
+		       ns / 1e6, ctx.width * ctx.height / (ns / 1e3));
+
+		free(ctx.y);
+		free(ctx.dst);
+	}
+
+	return EXIT_SUCCESS;
+}
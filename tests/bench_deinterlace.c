@@ -0,0 +1,126 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Times the temporal deinterlacer on a 1080i frame, on one core and
+ * spread over the worker threads the driver would start. Needs no VE,
+ * the kernel builds on x86 too, with the C fallback.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../deinterlace.h"
+#include "../thread_pool.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+struct bench_ctx
+{
+	struct thread_pool *pool;
+	surface_layout_t layout;
+	uint8_t *dst;
+	const uint8_t *frames[5];
+	int field;
+};
+
+// same as the decoder output, 32 aligned luma
+static void init_layout(surface_layout_t *layout, VdpYCbCrFormat format)
+{
+	uint32_t pitch = ALIGN(WIDTH, 32), height = ALIGN(HEIGHT, 32);
+
+	memset(layout, 0, sizeof(*layout));
+	layout->format = format;
+	layout->plane[0].pitch = layout->plane[0].width = pitch;
+	layout->plane[0].height = height;
+	layout->plane[1].offset = pitch * height;
+	layout->plane[1].height = height / 2;
+
+	if (format == VDP_YCBCR_FORMAT_NV12)
+	{
+		layout->num_planes = 2;
+		layout->plane[1].pitch = pitch;
+		layout->plane[1].width = pitch / 2;
+	}
+	else
+	{
+		layout->num_planes = 3;
+		layout->plane[1].pitch = layout->plane[1].width = ALIGN(WIDTH / 2, 16);
+		layout->plane[2] = layout->plane[1];
+		layout->plane[2].offset = layout->plane[1].offset + layout->plane[1].pitch * layout->plane[1].height;
+	}
+
+	plane_layout_t *last = &layout->plane[layout->num_planes - 1];
+	layout->size = last->offset + last->pitch * last->height;
+}
+
+static void run(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+
+	deinterlace_frame(ctx->pool, &ctx->layout, ctx->dst, ctx->frames, WIDTH, HEIGHT, ctx->field);
+	ctx->field = !ctx->field;
+}
+
+int main(void)
+{
+	static const VdpYCbCrFormat formats[] = { VDP_YCBCR_FORMAT_YV12, VDP_YCBCR_FORMAT_NV12 };
+	// one core, then as many as the driver uses
+	unsigned int threads[2] = { 0, bench_worker_threads() };
+	unsigned int num_threads = threads[1] ? 2 : 1;
+	struct bench_ctx ctx = { .field = 0 };
+	uint8_t *frames[5];
+	unsigned int f, i, j;
+
+	for (f = 0; f < ARRAY_SIZE(formats); f++)
+	{
+		init_layout(&ctx.layout, formats[f]);
+
+		// noise is the worst case, every pixel looks like motion
+		srand(1);
+		for (i = 0; i < 5; i++)
+		{
+			frames[i] = malloc(ctx.layout.size);
+			if (!frames[i])
+				return EXIT_FAILURE;
+			for (j = 0; j < ctx.layout.size; j++)
+				frames[i][j] = rand();
+			ctx.frames[i] = frames[i];
+		}
+		ctx.dst = malloc(ctx.layout.size);
+		if (!ctx.dst)
+			return EXIT_FAILURE;
+
+		for (i = 0; i < num_threads; i++)
+		{
+			ctx.pool = thread_pool_create(threads[i]);
+			double ns = bench_run(run, &ctx);
+			printf("deinterlace %s %dx%d, %u worker threads: %.2f ms/field, %.1f fields/s\n",
+			       formats[f] == VDP_YCBCR_FORMAT_NV12 ? "NV12" : "YV12", WIDTH, HEIGHT,
+			       thread_pool_size(ctx.pool) - 1, ns / 1e6, 1e9 / ns);
+			thread_pool_destroy(ctx.pool);
+		}
+
+		for (i = 0; i < 5; i++)
+			free(frames[i]);
+		free(ctx.dst);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Times get_bits of a tiled 4K surface, as decoded by VEs before H3,
+ * with the detiling on one core and split over the driver's worker
+ * threads. Runs on tests/fake_cedrus.c, the detiler needs 32-bit ARM.
+ */
+
+#include <stdlib.h>
+#include "bench.h"
+#include "fake_cedrus.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+struct bench_ctx
+{
+	VdpVideoSurface surface;
+	VdpYCbCrFormat format;
+	void *data[3];
+	uint32_t pitches[3];
+};
+
+static void run(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+
+	vdp_video_surface_get_bits_y_cb_cr(ctx->surface, ctx->format, ctx->data, ctx->pitches);
+}
+
+int main(void)
+{
+	static const VdpYCbCrFormat formats[] = { VDP_YCBCR_FORMAT_NV12, VDP_YCBCR_FORMAT_YV12 };
+	unsigned int threads[2] = { 0, bench_worker_threads() };
+	unsigned int num_threads = threads[1] ? 2 : 1;
+	unsigned int f, i;
+	struct bench_ctx ctx;
+	VdpDevice device;
+
+	uint8_t *buffer = malloc(WIDTH * HEIGHT * 3 / 2);
+	if (!buffer)
+		return EXIT_FAILURE;
+
+	fake_cedrus_ve_version = 0x1623;
+
+	for (i = 0; i < num_threads; i++)
+	{
+		if (!bench_device_create(&device, threads[i]))
+			return EXIT_FAILURE;
+
+		if (vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &ctx.surface) != VDP_STATUS_OK)
+			return EXIT_FAILURE;
+
+		for (f = 0; f < ARRAY_SIZE(formats); f++)
+		{
+			ctx.format = formats[f];
+			ctx.data[0] = buffer;
+			ctx.data[1] = buffer + WIDTH * HEIGHT;
+			ctx.pitches[0] = WIDTH;
+			if (ctx.format == VDP_YCBCR_FORMAT_NV12)
+			{
+				ctx.pitches[1] = WIDTH;
+			}
+			else
+			{
+				ctx.data[2] = buffer + WIDTH * HEIGHT * 5 / 4;
+				ctx.pitches[1] = ctx.pitches[2] = WIDTH / 2;
+			}
+
+			VdpStatus ret = vdp_video_surface_get_bits_y_cb_cr(ctx.surface, ctx.format, ctx.data, ctx.pitches);
+			if (ret != VDP_STATUS_OK)
+			{
+				printf("detile %s: get_bits failed (%d)\n", ctx.format == VDP_YCBCR_FORMAT_NV12 ? "NV12" : "YV12", ret);
+				continue;
+			}
+
+			double ns = bench_run(run, &ctx);
+			printf("detile %dx%d to %s, %u worker threads: %.2f ms/frame\n", WIDTH, HEIGHT,
+			       ctx.format == VDP_YCBCR_FORMAT_NV12 ? "NV12" : "YV12", threads[i], ns / 1e6);
+		}
+
+		vdp_video_surface_destroy(ctx.surface);
+		bench_device_destroy(device);
+	}
+
+	free(buffer);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Times YV12 get_bits of a 1080p surface, into buffers with the
+ * surface's pitches (one bulk copy per plane) and with padded ones (row
+ * by row), and the range cache maintenance that precedes it. Runs on
+ * tests/fake_cedrus.c, so the flushes only mean something on arm64,
+ * where they are done by range without libcedrus.
+ */
+
+#include <stdlib.h>
+#include "bench.h"
+#include "fake_cedrus.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+struct bench_ctx
+{
+	VdpVideoSurface surface;
+	video_surface_ctx_t *vs;
+	void *data[3];
+	uint32_t pitches[3];
+};
+
+static void run_get_bits(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+
+	vdp_video_surface_get_bits_y_cb_cr(ctx->surface, VDP_YCBCR_FORMAT_YV12, ctx->data, ctx->pitches);
+}
+
+#ifdef __aarch64__
+static void run_flush(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+
+	cache_flush_range(ctx->vs->yuv->data, 0, ctx->vs->layout.size);
+}
+#endif
+
+int main(void)
+{
+	// tight pitches match the surface, padded ones force row copies
+	static const uint32_t luma_pitches[] = { WIDTH, WIDTH + 128 };
+	struct bench_ctx ctx;
+	VdpDevice device;
+	unsigned int i;
+
+	fake_cedrus_ve_version = 0x1680;
+
+	if (!bench_device_create(&device, 0))
+		return EXIT_FAILURE;
+
+	if (vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, WIDTH, HEIGHT, &ctx.surface) != VDP_STATUS_OK)
+		return EXIT_FAILURE;
+	ctx.vs = handle_get(ctx.surface);
+
+	uint8_t *buffer = malloc((WIDTH + 128) * HEIGHT * 2);
+	if (!buffer)
+		return EXIT_FAILURE;
+
+	double mb = WIDTH * HEIGHT * 3 / 2 / 1e6;
+
+	for (i = 0; i < ARRAY_SIZE(luma_pitches); i++)
+	{
+		ctx.pitches[0] = luma_pitches[i];
+		ctx.pitches[1] = ctx.pitches[2] = luma_pitches[i] / 2;
+		ctx.data[0] = buffer;
+		ctx.data[1] = buffer + ctx.pitches[0] * HEIGHT;
+		ctx.data[2] = buffer + ctx.pitches[0] * HEIGHT * 5 / 4;
+
+		double ns = bench_run(run_get_bits, &ctx);
+		printf("get_bits %dx%d YV12, pitch %u: %.2f ms/frame, %.0f MB/s\n", WIDTH, HEIGHT,
+		       ctx.pitches[0], ns / 1e6, mb / (ns / 1e9));
+	}
+
+	mb = ctx.vs->layout.size / 1e6;
+#ifdef __aarch64__
+	double ns = bench_run(run_flush, &ctx);
+	printf("range flush of %.1f MB: %.2f ms, %.0f MB/s\n", mb, ns / 1e6, mb / (ns / 1e9));
+#else
+	printf("range flush of %.1f MB: whole buffer through libcedrus, not measured here\n", mb);
+#endif
+
+	free(buffer);
+	vdp_video_surface_destroy(ctx.surface);
+	bench_device_destroy(device);
+
+	return EXIT_SUCCESS;
+}
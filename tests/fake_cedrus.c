@@ -0,0 +1,98 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <stdlib.h>
+#include <cedrus/cedrus.h>
+#include "fake_cedrus.h"
+
+struct cedrus
+{
+	int unused;
+};
+
+struct cedrus_mem
+{
+	void *virt;
+	size_t size;
+};
+
+int fake_cedrus_ve_version = 0x1625;
+unsigned int fake_cedrus_flushes;
+
+cedrus_t *cedrus_open(void)
+{
+	return calloc(1, sizeof(struct cedrus));
+}
+
+void cedrus_close(cedrus_t *dev)
+{
+	free(dev);
+}
+
+int cedrus_get_ve_version(cedrus_t *dev)
+{
+	return fake_cedrus_ve_version;
+}
+
+cedrus_mem_t *cedrus_mem_alloc(cedrus_t *dev, size_t size)
+{
+	cedrus_mem_t *mem = calloc(1, sizeof(*mem));
+	if (!mem)
+		return NULL;
+
+	// page aligned like the real allocations
+	if (posix_memalign(&mem->virt, 4096, size) != 0)
+	{
+		free(mem);
+		return NULL;
+	}
+
+	mem->size = size;
+
+	return mem;
+}
+
+void cedrus_mem_free(cedrus_mem_t *mem)
+{
+	if (!mem)
+		return;
+
+	free(mem->virt);
+	free(mem);
+}
+
+void cedrus_mem_flush_cache(cedrus_mem_t *mem)
+{
+	fake_cedrus_flushes++;
+}
+
+void *cedrus_mem_get_pointer(const cedrus_mem_t *mem)
+{
+	return mem->virt;
+}
+
+// nothing but the VE and display would use these, any unique value does
+uint32_t cedrus_mem_get_phys_addr(const cedrus_mem_t *mem)
+{
+	return (uint32_t)(uintptr_t)mem->virt;
+}
+
+uint32_t cedrus_mem_get_bus_addr(const cedrus_mem_t *mem)
+{
+	return (uint32_t)(uintptr_t)mem->virt;
+}
@@ -0,0 +1,33 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __FAKE_CEDRUS_H__
+#define __FAKE_CEDRUS_H__
+
+/*
+ * libcedrus stand-in backed by plain heap memory, to run the parts of
+ * the driver that only need buffers on machines without a VE.
+ */
+
+// what cedrus_get_ve_version() reports, selects the decoder output format
+extern int fake_cedrus_ve_version;
+
+// calls of cedrus_mem_flush_cache(), which does nothing here
+extern unsigned int fake_cedrus_flushes;
+
+#endif
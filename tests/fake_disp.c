@@ -0,0 +1,104 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <cedrus/cedrus.h>
+#include "fake_disp.h"
+
+#define MAX_CALLS 256
+
+static unsigned long calls[MAX_CALLS];
+static unsigned int num_calls;
+
+int (*fake_disp_reply)(unsigned long request, void *args);
+
+int open(const char *path, int flags, ...)
+{
+	if (strcmp(path, "/dev/disp") == 0)
+		return FAKE_DISP_FD;
+
+	errno = ENOENT;
+	return -1;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+
+	va_start(ap, request);
+	void *args = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd != FAKE_DISP_FD)
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	if (num_calls < MAX_CALLS)
+		calls[num_calls] = request;
+	num_calls++;
+
+	return fake_disp_reply ? fake_disp_reply(request, args) : 0;
+}
+
+void fake_disp_reset(void)
+{
+	num_calls = 0;
+}
+
+unsigned int fake_disp_count(unsigned long request)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < num_calls && i < MAX_CALLS; i++)
+		if (calls[i] == request)
+			count++;
+
+	return count;
+}
+
+unsigned int fake_disp_total(void)
+{
+	return num_calls;
+}
+
+// 1080p NV12 video with a subtitle line on the OSD
+void fake_disp_init_surface(output_surface_ctx_t *os, yuv_data_t *yuv, cedrus_t *cedrus)
+{
+	memset(os, 0, sizeof(*os));
+	yuv->ref_count = 1;
+	yuv->data = cedrus_mem_alloc(cedrus, 1920 * 1088 * 3 / 2);
+	os->yuv = yuv;
+	os->video_layout.format = VDP_YCBCR_FORMAT_NV12;
+	os->video_layout.num_planes = 2;
+	os->video_layout.plane[0] = (plane_layout_t){ .offset = 0, .pitch = 1920, .width = 1920, .height = 1088 };
+	os->video_layout.plane[1] = (plane_layout_t){ .offset = 1920 * 1088, .pitch = 1920, .width = 960, .height = 544 };
+	os->video_height = 1080;
+	os->video_src_rect = (VdpRect){ 0, 0, 1920, 1080 };
+	os->video_dst_rect = (VdpRect){ 0, 0, 1920, 1080 };
+	os->rgba.format = VDP_RGBA_FORMAT_B8G8R8A8;
+	os->rgba.width = 1920;
+	os->rgba.height = 1080;
+	os->rgba.data = cedrus_mem_alloc(cedrus, 1920 * 1080 * 4);
+	os->rgba.dirty.bounds = (VdpRect){ 0, 900, 1920, 1000 };
+}
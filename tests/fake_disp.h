@@ -0,0 +1,41 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifndef __FAKE_DISP_H__
+#define __FAKE_DISP_H__
+
+/*
+ * /dev/disp stand-in, replaces open() and ioctl() of the C library to
+ * count what a display backend sends to the driver. The three driver
+ * versions have clashing headers, so each test answers for its own.
+ */
+
+#include "../vdpau_private.h"
+
+#define FAKE_DISP_FD 43
+
+// answers an ioctl, args point to what the backend passed
+extern int (*fake_disp_reply)(unsigned long request, void *args);
+
+void fake_disp_reset(void);
+unsigned int fake_disp_count(unsigned long request);
+unsigned int fake_disp_total(void);
+
+void fake_disp_init_surface(output_surface_ctx_t *os, yuv_data_t *yuv, cedrus_t *cedrus);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Checks that the disp1.5 backend only enables and reconfigures layers
+ * that changed, against the counting /dev/disp stand-in.
+ */
+
+#include <cedrus/cedrus.h>
+#include "test.h"
+#include "fake_disp.h"
+#include "../vdpau_private.h"
+#include "../sunxi_disp.h"
+#include "../kernel-headers/drv_display.h"
+
+static int reply(unsigned long request, void *args)
+{
+	switch (request)
+	{
+	case DISP_CMD_GET_SCN_WIDTH:
+		return 1920;
+	case DISP_CMD_VSYNC_EVENT_EN:
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+static void test_video(struct sunxi_disp *disp, output_surface_ctx_t *os, yuv_data_t *other)
+{
+	yuv_data_t *yuv = os->yuv;
+
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_ENABLE) == 1);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_SET_INFO) == 1);
+	CHECK(fake_disp_total() == 2);
+
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_total() == 0);
+
+	// there is no cheaper ioctl for new addresses, but no enabling either
+	fake_disp_reset();
+	os->yuv = other;
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_SET_INFO) == 1);
+	CHECK(fake_disp_total() == 1);
+	os->yuv = yuv;
+
+	fake_disp_reset();
+	disp->close_video_layer(disp);
+	disp->close_video_layer(disp);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_DISABLE) == 1);
+	CHECK(fake_disp_total() == 1);
+
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_ENABLE) == 1);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_SET_INFO) == 1);
+}
+
+static void test_osd(struct sunxi_disp *disp, output_surface_ctx_t *os)
+{
+	fake_disp_reset();
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_ENABLE) == 1);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_SET_INFO) == 1);
+
+	fake_disp_reset();
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_total() == 0);
+
+	fake_disp_reset();
+	os->rgba.dirty.bounds.y0 = 950;
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_count(DISP_CMD_LAYER_SET_INFO) == 1);
+	CHECK(fake_disp_total() == 1);
+}
+
+int main(void)
+{
+	cedrus_t *cedrus = cedrus_open();
+	output_surface_ctx_t os;
+	yuv_data_t yuv, other = { 1, cedrus_mem_alloc(cedrus, 1920 * 1088 * 3 / 2) };
+
+	fake_disp_reply = reply;
+
+	struct sunxi_disp_device *device = sunxi_disp1_5_open(1);
+	CHECK(device != NULL);
+	if (!device)
+		return test_result("test_disp1_5");
+
+	struct sunxi_disp *disp = device->open_target(device);
+	CHECK(disp != NULL);
+	if (disp)
+	{
+		fake_disp_init_surface(&os, &yuv, cedrus);
+
+		test_video(disp, &os, &other);
+		test_osd(disp, &os);
+
+		disp->close(disp);
+		cedrus_mem_free(yuv.data);
+		cedrus_mem_free(os.rgba.data);
+	}
+
+	device->close(device);
+	cedrus_mem_free(other.data);
+	cedrus_close(cedrus);
+
+	return test_result("test_disp1_5");
+}
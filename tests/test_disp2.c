@@ -0,0 +1,160 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Checks that the disp2 backend sends all changed layers in one
+ * ioctl per commit and nothing if none changed, against the counting
+ * /dev/disp stand-in.
+ */
+
+#include <string.h>
+#include <cedrus/cedrus.h>
+#include "test.h"
+#include "fake_disp.h"
+#include "../vdpau_private.h"
+#include "../sunxi_disp.h"
+#include "../kernel-headers/sunxi_display2.h"
+
+// configs of the last DISP_LAYER_SET_CONFIG
+static disp_layer_config configs[8];
+static unsigned long num_configs;
+
+static int reply(unsigned long request, void *args)
+{
+	unsigned long *a = args;
+
+	switch (request)
+	{
+	case DISP_LAYER_SET_CONFIG:
+		num_configs = a[2];
+		memcpy(configs, (void *)a[1], num_configs * sizeof(disp_layer_config));
+		return 0;
+	case DISP_GET_SCN_WIDTH:
+		return 1920;
+	case DISP_VSYNC_EVENT_EN:
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+static void test_commit(struct sunxi_disp *disp, output_surface_ctx_t *os, yuv_data_t *other)
+{
+	yuv_data_t *yuv = os->yuv;
+
+	// setting layers is deferred, the commit sends both at once
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	CHECK(fake_disp_total() == 0);
+	disp->commit(disp);
+	CHECK(fake_disp_count(DISP_LAYER_SET_CONFIG) == 1);
+	CHECK(fake_disp_total() == 1);
+	CHECK(num_configs == 2);
+	CHECK(configs[0].enable && configs[0].channel == 0);
+	CHECK(configs[1].enable && configs[1].channel == 2);
+
+	// an unchanged frame sends nothing
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	disp->commit(disp);
+	CHECK(fake_disp_total() == 0);
+
+	// a new video frame sends only the video layer
+	fake_disp_reset();
+	os->yuv = other;
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	disp->set_osd_layer(disp, 0, 0, 1920, 1080, os);
+	disp->commit(disp);
+	CHECK(fake_disp_total() == 1);
+	CHECK(num_configs == 1);
+	CHECK(configs[0].channel == 0 && configs[0].info.fb.addr[0] == cedrus_mem_get_phys_addr(other->data));
+	os->yuv = yuv;
+
+	// closing is deferred to the commit too
+	fake_disp_reset();
+	disp->close_osd_layer(disp);
+	CHECK(fake_disp_total() == 0);
+	disp->commit(disp);
+	CHECK(fake_disp_total() == 1);
+	CHECK(num_configs == 1);
+	CHECK(configs[0].channel == 2 && !configs[0].enable);
+
+	fake_disp_reset();
+	disp->close_osd_layer(disp);
+	disp->commit(disp);
+	CHECK(fake_disp_total() == 0);
+}
+
+// channels are blended as a whole, no mixer layer may go below the video
+static void test_extra_above_video(struct sunxi_disp *disp, output_surface_ctx_t *os)
+{
+	mixer_layer_t layer = { .ref_count = 1, .rgba = os->rgba, .dst = { 0, 0, 1920, 1080 } };
+	int i;
+
+	CHECK(disp->num_extra_layers > 0);
+
+	fake_disp_reset();
+	disp->set_video_layer(disp, 0, 0, 1920, 1080, os);
+	for (i = 0; i < disp->num_extra_layers; i++)
+		disp->set_extra_layer(disp, i, 0, 0, 1920, 1080, &layer);
+	disp->commit(disp);
+	CHECK(fake_disp_total() == 1);
+	CHECK(num_configs == 1 + disp->num_extra_layers);
+	for (i = 1; i < num_configs; i++)
+		CHECK(configs[i].channel == 2 && configs[i].info.zorder > configs[0].info.zorder);
+
+	for (i = 0; i < disp->num_extra_layers; i++)
+		disp->close_extra_layer(disp, i);
+	disp->commit(disp);
+}
+
+int main(void)
+{
+	cedrus_t *cedrus = cedrus_open();
+	output_surface_ctx_t os;
+	yuv_data_t yuv, other = { 1, cedrus_mem_alloc(cedrus, 1920 * 1088 * 3 / 2) };
+
+	fake_disp_reply = reply;
+
+	struct sunxi_disp_device *device = sunxi_disp2_open(1);
+	CHECK(device != NULL);
+	if (!device)
+		return test_result("test_disp2");
+
+	struct sunxi_disp *disp = device->open_target(device);
+	CHECK(disp != NULL);
+	if (disp)
+	{
+		fake_disp_init_surface(&os, &yuv, cedrus);
+
+		test_commit(disp, &os, &other);
+		test_extra_above_video(disp, &os);
+
+		disp->close(disp);
+		cedrus_mem_free(yuv.data);
+		cedrus_mem_free(os.rgba.data);
+	}
+
+	device->close(device);
+	cedrus_mem_free(other.data);
+	cedrus_close(cedrus);
+
+	return test_result("test_disp2");
+}
@@ -0,0 +1,195 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/*
+ * Runs the G2D command queue against a recording stand-in for /dev/g2d,
+ * the ioctl() below replaces the C library's for this program.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <cedrus/cedrus.h>
+#include "test.h"
+#include "../vdpau_private.h"
+#include "../rgba_g2d.h"
+#include "../kernel-headers/g2d_driver.h"
+
+#define G2D_FD 42
+#define MAX_RECORDED 256
+
+static struct
+{
+	unsigned long request;
+	union
+	{
+		g2d_fillrect fill;
+		g2d_blt blt;
+		g2d_stretchblt stretch;
+	} args;
+} recorded[MAX_RECORDED];
+static unsigned int num_recorded;
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+
+	va_start(ap, request);
+	void *arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd != G2D_FD || num_recorded == MAX_RECORDED)
+		return -1;
+
+	recorded[num_recorded].request = request;
+	memcpy(&recorded[num_recorded].args, arg, request == G2D_CMD_FILLRECT ? sizeof(g2d_fillrect) :
+	       request == G2D_CMD_BITBLT ? sizeof(g2d_blt) : sizeof(g2d_stretchblt));
+	num_recorded++;
+
+	return 0;
+}
+
+static device_ctx_t device = { .g2d_fd = G2D_FD, .g2d_enabled = 1 };
+
+static void init_surface(rgba_surface_t *rgba, uint32_t width, uint32_t height)
+{
+	memset(rgba, 0, sizeof(*rgba));
+	rgba->device = &device;
+	rgba->format = VDP_RGBA_FORMAT_B8G8R8A8;
+	rgba->width = width;
+	rgba->height = height;
+	rgba->data = cedrus_mem_alloc(device.cedrus, width * height * 4);
+}
+
+static void reset(void)
+{
+	g2d_sync(&device);
+	num_recorded = 0;
+}
+
+// nothing reaches the driver before a sync, then everything in order
+static void test_queued_until_sync(rgba_surface_t *a, rgba_surface_t *b)
+{
+	VdpRect r1 = { 0, 0, 10, 10 }, r2 = { 20, 20, 30, 30 };
+
+	reset();
+	g2d_fill(a, &r1, 0xff000001);
+	g2d_blit(b, &r2, a, &r1, 0, 0xffffffff);
+	g2d_fill(a, &r2, 0xff000002);
+	CHECK(num_recorded == 0);
+
+	g2d_sync(&device);
+	CHECK(num_recorded == 3);
+	CHECK(recorded[0].request == G2D_CMD_FILLRECT && recorded[0].args.fill.color == 0x000001);
+	CHECK(recorded[1].request == G2D_CMD_BITBLT && recorded[1].args.blt.dst_x == 20);
+	CHECK(recorded[2].request == G2D_CMD_FILLRECT && recorded[2].args.fill.color == 0x000002);
+}
+
+// a fill replacing earlier results drops them, like redrawing the same subtitle line
+static void test_covered_dropped(rgba_surface_t *a)
+{
+	VdpRect small = { 5, 5, 10, 10 }, full = { 0, 0, 64, 64 };
+
+	reset();
+	g2d_fill(a, &small, 0xff000001);
+	g2d_fill(a, &small, 0xff000002);
+	g2d_fill(a, &full, 0xff000003);
+	g2d_sync(&device);
+	CHECK(num_recorded == 1);
+	CHECK(recorded[0].args.fill.color == 0x000003);
+	CHECK(recorded[0].args.fill.dst_rect.w == 64);
+}
+
+// unless a blit reads the surface in between
+static void test_read_keeps(rgba_surface_t *a, rgba_surface_t *b)
+{
+	VdpRect r = { 0, 0, 16, 16 };
+
+	reset();
+	g2d_fill(a, &r, 0xff000001);
+	g2d_blit(b, &r, a, &r, 0, 0xffffffff);
+	g2d_fill(a, &r, 0xff000002);
+	g2d_sync(&device);
+	CHECK(num_recorded == 3);
+}
+
+// blending onto the destination doesn't replace it
+static void test_blend_keeps(rgba_surface_t *a, rgba_surface_t *b)
+{
+	VdpRect r = { 0, 0, 16, 16 };
+
+	reset();
+	g2d_fill(b, &r, 0xff000001);
+	g2d_blit(b, &r, a, &r, 0, 0xffffffff);
+	g2d_sync(&device);
+	CHECK(num_recorded == 2);
+	CHECK(recorded[1].args.blt.flag == G2D_BLT_PIXEL_ALPHA);
+}
+
+static void test_stretch(rgba_surface_t *a, rgba_surface_t *b)
+{
+	VdpRect src = { 0, 0, 16, 16 }, dst = { 0, 0, 32, 32 };
+
+	reset();
+	g2d_blit(b, &dst, a, &src, 0, 0xffffffff);
+	g2d_sync(&device);
+	CHECK(num_recorded == 1);
+	CHECK(recorded[0].request == G2D_CMD_STRETCHBLT && recorded[0].args.stretch.dst_rect.w == 32);
+}
+
+// a full queue gets submitted on its own, without losing commands
+static void test_overflow(rgba_surface_t *a)
+{
+	unsigned int i;
+
+	reset();
+	for (i = 0; i < 100; i++)
+	{
+		VdpRect r = { i % 64, i / 64, i % 64 + 1, i / 64 + 1 };
+		g2d_fill(a, &r, 0xff000000 | i);
+	}
+	CHECK(num_recorded > 0 && num_recorded < 100);
+
+	g2d_sync(&device);
+	CHECK(num_recorded == 100);
+	for (i = 0; i < num_recorded && recorded[i].args.fill.color == i; i++)
+		;
+	CHECK(i == 100);
+}
+
+int main(void)
+{
+	rgba_surface_t a, b;
+
+	device.cedrus = cedrus_open();
+	init_surface(&a, 64, 64);
+	init_surface(&b, 64, 64);
+
+	test_queued_until_sync(&a, &b);
+	test_covered_dropped(&a);
+	test_read_keeps(&a, &b);
+	test_blend_keeps(&a, &b);
+	test_stretch(&a, &b);
+	test_overflow(&a);
+
+	g2d_close(&device);
+	cedrus_mem_free(a.data);
+	cedrus_mem_free(b.data);
+	cedrus_close(device.cedrus);
+
+	return test_result("test_g2d");
+}
@@ -0,0 +1,162 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "thread_pool.h"
+
+struct thread_pool
+{
+	pthread_mutex_t lock;
+	pthread_mutex_t run_lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	void (*func)(void *arg, unsigned int index);
+	void *arg;
+	unsigned int next;
+	unsigned int count;
+	unsigned int pending;
+	int quit;
+
+	unsigned int num_threads;
+	pthread_t threads[];
+};
+
+static void *thread_pool_worker(void *data)
+{
+	struct thread_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1)
+	{
+		while (!pool->quit && pool->next >= pool->count)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+
+		if (pool->quit)
+			break;
+
+		unsigned int index = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		pool->func(pool->arg, index);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct thread_pool *thread_pool_create(unsigned int num_threads)
+{
+	if (num_threads == 0)
+		return NULL;
+
+	struct thread_pool *pool = calloc(1, sizeof(*pool) + num_threads * sizeof(pthread_t));
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_mutex_init(&pool->run_lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (pool->num_threads = 0; pool->num_threads < num_threads; pool->num_threads++)
+		if (pthread_create(&pool->threads[pool->num_threads], NULL, thread_pool_worker, pool))
+			break;
+
+	if (pool->num_threads == 0)
+	{
+		thread_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->run_lock);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+unsigned int thread_pool_size(struct thread_pool *pool)
+{
+	return pool ? pool->num_threads + 1 : 1;
+}
+
+void thread_pool_run(struct thread_pool *pool,
+                     void (*func)(void *arg, unsigned int index),
+                     void *arg,
+                     unsigned int count)
+{
+	unsigned int i;
+
+	if (!pool || count <= 1)
+	{
+		for (i = 0; i < count; i++)
+			func(arg, i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->run_lock);
+	pthread_mutex_lock(&pool->lock);
+
+	pool->func = func;
+	pool->arg = arg;
+	pool->next = 0;
+	pool->count = count;
+	pool->pending = count;
+	pthread_cond_broadcast(&pool->work_cond);
+
+	// help out instead of just waiting
+	while (pool->next < pool->count)
+	{
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		func(arg, i);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->pending--;
+	}
+
+	while (pool->pending)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_unlock(&pool->run_lock);
+}
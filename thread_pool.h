@@ -0,0 +1,38 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+struct thread_pool;
+
+struct thread_pool *thread_pool_create(unsigned int num_threads);
+void thread_pool_destroy(struct thread_pool *pool);
+
+unsigned int thread_pool_size(struct thread_pool *pool);
+
+/*
+ * Calls func(arg, i) for every i in [0, count), spread over the pool's
+ * threads and the calling thread, and returns once all calls finished.
+ * A NULL pool runs everything on the calling thread.
+ */
+void thread_pool_run(struct thread_pool *pool,
+                     void (*func)(void *arg, unsigned int index),
+                     void *arg,
+                     unsigned int count);
+
+#endif
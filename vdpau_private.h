@@ -23,12 +23,20 @@
 #define DEBUG
 #define MAX_HANDLES 64
 #define VBV_SIZE (1 * 1024 * 1024)
+#define MAX_WORKER_THREADS 3
+#define PRESENTATION_QUEUE_LENGTH 16
+// deinterlaced frames per mixer, queued ahead plus shown, more fall back to bob
+#define DEINT_MAX_BUFFERS 4
+// copies per output surface and display layer, more get composited into the OSD
+#define MIXER_LAYER_COPIES 2
 
 #include <stdlib.h>
+#include <pthread.h>
 #include <cedrus/cedrus.h>
 #include <vdpau/vdpau.h>
 #include <vdpau/vdpau_x11.h>
 #include <X11/Xlib.h>
+#include "vdpau_sunxi.h"
 #include "sunxi_disp.h"
 #include "pixman.h"
 
@@ -39,12 +47,18 @@ typedef struct
 	cedrus_t *cedrus;
 	Display *display;
 	int screen;
+	unsigned int geometry_serial;
 	VdpPreemptionCallback *preemption_callback;
 	void *preemption_callback_context;
 	int fd;
 	int g2d_fd;
 	int osd_enabled;
 	int g2d_enabled;
+	struct g2d_cmd *g2d_cmds;
+	unsigned int g2d_num_cmds;
+	struct atlas_page *atlas;
+	struct sunxi_disp_device *disp;
+	struct thread_pool *thread_pool;
 } device_ctx_t;
 
 typedef struct
@@ -53,14 +67,35 @@ typedef struct
 	cedrus_mem_t *data;
 } yuv_data_t;
 
+/*
+ * Planes are in Y, Cb, Cr order, NV12 and the tiled format have
+ * a single interleaved chroma plane, packed formats only plane[0].
+ */
+typedef struct
+{
+	uint32_t offset;
+	uint32_t pitch;
+	uint32_t width; // pitch in pixels, what the display engine wants
+	uint32_t height;
+} plane_layout_t;
+
+typedef struct
+{
+	VdpYCbCrFormat format;
+	int num_planes;
+	plane_layout_t plane[3];
+	uint32_t size;
+} surface_layout_t;
+
 typedef struct video_surface_ctx_struct
 {
 	device_ctx_t *device;
 	uint32_t width, height;
 	VdpChromaType chroma_type;
-	VdpYCbCrFormat source_format;
+	surface_layout_t layout;
+	uint32_t alloc_size;
 	yuv_data_t *yuv;
-	int luma_size, chroma_size;
+	int mapped;
 	void *decoder_private;
 	void (*decoder_private_free)(struct video_surface_ctx_struct *surface);
 } video_surface_ctx_t;
@@ -80,13 +115,50 @@ typedef struct
 {
 	Drawable drawable;
 	struct sunxi_disp *disp;
+	int x, y;
+	unsigned int geometry_serial;
+	device_ctx_t *device;
 } queue_target_ctx_t;
 
+/*
+ * Everything needed to flip to a surface, window position and OSD state
+ * are evaluated when it gets queued.
+ */
+typedef struct
+{
+	output_surface_ctx_t *surface;
+	VdpTime earliest_presentation_time;
+	int x, y;
+	uint32_t clip_width, clip_height;
+	int show_osd;
+	mixer_layer_t *layers[SUNXI_DISP_MAX_EXTRA_LAYERS];
+} queue_entry_t;
+
 typedef struct
 {
 	queue_target_ctx_t *target;
 	VdpColor background;
 	device_ctx_t *device;
+	pthread_t flip_thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;
+	pthread_cond_t flipped;
+	queue_entry_t entries[PRESENTATION_QUEUE_LENGTH];
+	unsigned int head, count;
+	output_surface_ctx_t *visible, *flipping;
+	// layers on screen, and those replaced since, for the queueing thread to drop
+	mixer_layer_t *visible_layers[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	mixer_layer_t *retired_layers[(PRESENTATION_QUEUE_LENGTH + 1) * SUNXI_DISP_MAX_EXTRA_LAYERS];
+	unsigned int num_retired_layers;
+	int quit;
+	VdpTime vsync_period, last_vsync;
+	struct
+	{
+		unsigned int frames, late;
+		uint64_t lateness_sum, lateness_max;
+		uint64_t interval_error_sum;
+		VdpTime last_presentation_time;
+	} stats;
 } queue_ctx_t;
 
 typedef struct
@@ -97,11 +169,30 @@ typedef struct
 	float contrast;
 	float saturation;
 	float hue;
+	// requested at creation, enabled only through the feature enables
+	int deinterlace_requested;
+	int deinterlace;
+	uint32_t deint_size;
+	unsigned int deint_num_buffers;
+	yuv_data_t *deint_buffers[DEINT_MAX_BUFFERS];
 } mixer_ctx_t;
 
 #define RGBA_FLAG_DIRTY (1 << 0)
 #define RGBA_FLAG_NEEDS_FLUSH (1 << 1)
 #define RGBA_FLAG_NEEDS_CLEAR (1 << 2)
+#define RGBA_FLAG_NEEDS_INVALIDATE (1 << 3)
+#define RGBA_FLAG_HEAP (1 << 4)
+#define RGBA_FLAG_ATLAS (1 << 5)
+
+#define RGBA_MAX_RECTS 4
+
+// a few, possibly overlapping, rectangles and their bounding box
+typedef struct
+{
+	VdpRect bounds;
+	int num_rects;
+	VdpRect rects[RGBA_MAX_RECTS];
+} rgba_region_t;
 
 typedef struct
 {
@@ -109,22 +200,46 @@ typedef struct
 	VdpRGBAFormat format;
 	uint32_t width, height;
 	cedrus_mem_t *data;
-	VdpRect dirty;
+	uint32_t offset;
+	void *pixels;
+	rgba_region_t dirty;
+	rgba_region_t unflushed;
 	uint32_t flags;
 	pixman_image_t *pimage;
+	pixman_transform_t ptransform;
 } rgba_surface_t;
 
+/*
+ * Copy of a video mixer layer (or the background) taken at render time,
+ * shown on its own display layer. The output surface's pool and queue
+ * entries hold references, only the queueing thread takes and drops them.
+ */
+typedef struct mixer_layer_struct
+{
+	int ref_count;
+	rgba_surface_t rgba;
+	VdpRect dst;
+} mixer_layer_t;
+
 typedef struct output_surface_ctx_struct
 {
 	rgba_surface_t rgba;
-	video_surface_ctx_t *vs;
 	yuv_data_t *yuv;
+	// what the display scans out of yuv, fixed at render time
+	surface_layout_t video_layout;
+	uint32_t video_height;
 	VdpRect video_src_rect, video_dst_rect;
+	// the copies shown with this surface, taken from its pool
+	mixer_layer_t *layers[SUNXI_DISP_MAX_EXTRA_LAYERS];
+	mixer_layer_t *layer_copies[SUNXI_DISP_MAX_EXTRA_LAYERS][MIXER_LAYER_COPIES];
 	int csc_change;
 	float brightness;
 	float contrast;
 	float saturation;
 	float hue;
+	queue_ctx_t *queue;
+	VdpPresentationQueueStatus status;
+	VdpTime first_presentation_time;
 } output_surface_ctx_t;
 
 typedef struct
@@ -178,7 +293,16 @@ VdpStatus new_decoder_h265(decoder_ctx_t *decoder);
 
 void yuv_unref(yuv_data_t *yuv);
 yuv_data_t *yuv_ref(yuv_data_t *yuv);
+mixer_layer_t *mixer_layer_ref(mixer_layer_t *layer);
+void mixer_layer_unref(mixer_layer_t *layer);
 VdpStatus yuv_prepare(video_surface_ctx_t *video_surface);
+void video_surface_set_format(video_surface_ctx_t *video_surface, VdpYCbCrFormat format);
+void video_surface_scanout(video_surface_ctx_t *vs, VdpVideoMixerPictureStructure field, output_surface_ctx_t *os);
+void presentation_queue_release_surface(output_surface_ctx_t *surface);
+
+int cache_flush_range(cedrus_mem_t *mem, size_t offset, size_t size);
+uint64_t cache_flushed_bytes(void);
+uint64_t cache_flushed_buffers(void);
 
 typedef uint32_t VdpHandle;
 
@@ -214,6 +338,10 @@ VdpVideoSurfaceGetBitsYCbCr vdp_video_surface_get_bits_y_cb_cr;
 VdpVideoSurfacePutBitsYCbCr vdp_video_surface_put_bits_y_cb_cr;
 VdpVideoSurfaceQueryCapabilities vdp_video_surface_query_capabilities;
 VdpVideoSurfaceQueryGetPutBitsYCbCrCapabilities vdp_video_surface_query_get_put_bits_y_cb_cr_capabilities;
+VdpSunxiVideoSurfaceMap vdp_sunxi_video_surface_map;
+VdpSunxiVideoSurfaceUnmap vdp_sunxi_video_surface_unmap;
+VdpSunxiCacheStatistics vdp_sunxi_cache_statistics;
+VdpSunxiPresentationQueueStatistics vdp_sunxi_presentation_queue_statistics;
 
 VdpOutputSurfaceCreate vdp_output_surface_create;
 VdpOutputSurfaceDestroy vdp_output_surface_destroy;
@@ -0,0 +1,77 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __VDPAU_SUNXI_H__
+#define __VDPAU_SUNXI_H__
+
+#include <vdpau/vdpau.h>
+
+/*
+ * Driver specific extensions, retrieved through VdpGetProcAddress.
+ */
+
+#define VDP_FUNC_ID_SUNXI_VIDEO_SURFACE_MAP   (VDP_FUNC_ID_BASE_DRIVER + 0)
+#define VDP_FUNC_ID_SUNXI_VIDEO_SURFACE_UNMAP (VDP_FUNC_ID_BASE_DRIVER + 1)
+#define VDP_FUNC_ID_SUNXI_CACHE_STATISTICS    (VDP_FUNC_ID_BASE_DRIVER + 2)
+#define VDP_FUNC_ID_SUNXI_PRESENTATION_QUEUE_STATISTICS (VDP_FUNC_ID_BASE_DRIVER + 3)
+
+/*
+ * Map the planes of a video surface for direct CPU writes, replacing
+ * VdpVideoSurfacePutBitsYCbCr without the copy. data and pitches get
+ * one entry per plane, in the same order put_bits expects them.
+ * Supported are NV12 and YV12 for 4:2:0 and YUYV and UYVY for 4:2:2
+ * surfaces. The previous content of the surface is undefined.
+ *
+ * The surface must be unmapped before it is used by the hardware
+ * again, unmapping flushes the CPU caches. Decoding to, putting bits
+ * into or mixing a mapped surface fails with VDP_STATUS_ERROR.
+ */
+typedef VdpStatus VdpSunxiVideoSurfaceMap(VdpVideoSurface surface,
+                                          VdpYCbCrFormat ycbcr_format,
+                                          void **data,
+                                          uint32_t *pitches);
+
+typedef VdpStatus VdpSunxiVideoSurfaceUnmap(VdpVideoSurface surface);
+
+/*
+ * CPU cache maintenance done so far by the whole process. On arm64 only
+ * the touched lines get flushed, flushed_bytes counts them. 32-bit ARM
+ * always flushes whole buffers, flushed_buffers counts those.
+ */
+typedef VdpStatus VdpSunxiCacheStatistics(VdpDevice device,
+                                          uint64_t *flushed_bytes,
+                                          uint64_t *flushed_buffers);
+
+/*
+ * Flip timing of a presentation queue since it was created, times are in
+ * nanoseconds. Lateness is how long after its earliest presentation time
+ * a surface became visible, jitter how far the interval between two
+ * surfaces is off a whole number of vsync periods.
+ */
+typedef struct
+{
+	uint32_t frames;
+	uint32_t late; // by a vsync period or more
+	uint64_t vsync_period;
+	uint64_t lateness_avg, lateness_max;
+	uint64_t jitter_avg;
+} VdpSunxiPresentationQueueStats;
+
+typedef VdpStatus VdpSunxiPresentationQueueStatistics(VdpPresentationQueue presentation_queue,
+                                                      VdpSunxiPresentationQueueStats *stats);
+
+#endif
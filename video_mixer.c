@@ -18,10 +18,14 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
 #include <cedrus/cedrus.h>
 #include "vdpau_private.h"
+#include "deinterlace.h"
 #include "rgba.h"
 
+static void free_deint_buffers(mixer_ctx_t *mix);
+
 VdpStatus vdp_video_mixer_create(VdpDevice device,
                                  uint32_t feature_count,
                                  VdpVideoMixerFeature const *features,
@@ -42,6 +46,11 @@ VdpStatus vdp_video_mixer_create(VdpDevice device,
 	mix->contrast = 1.0;
 	mix->saturation = 1.0;
 
+	uint32_t i;
+	for (i = 0; i < feature_count; i++)
+		if (features[i] == VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL)
+			mix->deinterlace_requested = 1;
+
 	return VDP_STATUS_OK;
 }
 
@@ -51,11 +60,317 @@ VdpStatus vdp_video_mixer_destroy(VdpVideoMixer mixer)
 	if (!mix)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	free_deint_buffers(mix);
+
 	handle_destroy(mixer);
 
 	return VDP_STATUS_OK;
 }
 
+// buffers still shown are freed once their output surface lets go of them
+static void free_deint_buffers(mixer_ctx_t *mix)
+{
+	unsigned int i;
+
+	for (i = 0; i < mix->deint_num_buffers; i++)
+		yuv_unref(mix->deint_buffers[i]);
+
+	mix->deint_num_buffers = 0;
+}
+
+// a pool buffer no output surface holds anymore, or a new one
+static yuv_data_t *get_deint_buffer(mixer_ctx_t *mix, uint32_t size)
+{
+	unsigned int i;
+
+	if (mix->deint_size != size)
+	{
+		free_deint_buffers(mix);
+		mix->deint_size = size;
+	}
+
+	for (i = 0; i < mix->deint_num_buffers; i++)
+		if (mix->deint_buffers[i]->ref_count == 1)
+			return yuv_ref(mix->deint_buffers[i]);
+
+	if (mix->deint_num_buffers >= ARRAY_SIZE(mix->deint_buffers))
+	{
+		VDPAU_DBG_ONCE("All deinterlacing buffers queued, showing fields by bob");
+		return NULL;
+	}
+
+	yuv_data_t *yuv = calloc(1, sizeof(*yuv));
+	if (!yuv)
+		return NULL;
+
+	yuv->ref_count = 1;
+	yuv->data = cedrus_mem_alloc(mix->device->cedrus, size);
+	if (!yuv->data)
+	{
+		free(yuv);
+		return NULL;
+	}
+
+	mix->deint_buffers[mix->deint_num_buffers++] = yuv;
+
+	return yuv_ref(yuv);
+}
+
+/*
+ * Deinterlaces the field into a pool buffer with the surface's layout,
+ * returns NULL if the field has to be shown by bob instead.
+ */
+static yuv_data_t *deinterlace(mixer_ctx_t *mix, video_surface_ctx_t *vs,
+                               VdpVideoMixerPictureStructure field,
+                               uint32_t past_count, VdpVideoSurface const *past,
+                               uint32_t future_count, VdpVideoSurface const *future)
+{
+	video_surface_ctx_t *surfaces[5] = { NULL, NULL, vs, NULL, NULL };
+	const uint8_t *frames[5];
+	int i, j;
+
+	if (!mix->deinterlace || field == VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME)
+		return NULL;
+
+	if (past_count < 1 || !past || future_count < 1 || !future)
+		return NULL;
+
+	if (vs->layout.format != VDP_YCBCR_FORMAT_YV12 && vs->layout.format != VDP_YCBCR_FORMAT_NV12)
+	{
+		VDPAU_DBG_ONCE("Deinterlacing only supported for planar surfaces");
+		return NULL;
+	}
+
+	if (vs->height < 2)
+		return NULL;
+
+	surfaces[1] = handle_get(past[0]);
+	surfaces[3] = handle_get(future[0]);
+	if (past_count > 1)
+		surfaces[0] = handle_get(past[1]);
+	if (future_count > 1)
+		surfaces[4] = handle_get(future[1]);
+
+	// mapped neighbours may be half written
+	for (i = 0; i < 5; i++)
+		if (surfaces[i] && (surfaces[i]->width != vs->width || surfaces[i]->height != vs->height ||
+		                    surfaces[i]->layout.format != vs->layout.format || surfaces[i]->mapped))
+			surfaces[i] = NULL;
+
+	if (!surfaces[1] || !surfaces[3])
+		return NULL;
+
+	yuv_data_t *yuv = get_deint_buffer(mix, vs->layout.size);
+	if (!yuv)
+		return NULL;
+
+	for (i = 0; i < 5; i++)
+	{
+		frames[i] = NULL;
+		if (!surfaces[i])
+			continue;
+
+		// the decoder wrote them, each buffer needs its cache flushed once
+		for (j = 0; j < i; j++)
+			if (surfaces[j] && surfaces[j]->yuv == surfaces[i]->yuv)
+				break;
+		if (j == i)
+			cache_flush_range(surfaces[i]->yuv->data, 0, vs->layout.size);
+
+		frames[i] = cedrus_mem_get_pointer(surfaces[i]->yuv->data);
+	}
+
+	deinterlace_frame(mix->device->thread_pool, &vs->layout, cedrus_mem_get_pointer(yuv->data),
+	                  frames, vs->width, vs->height,
+	                  field == VDP_VIDEO_MIXER_PICTURE_STRUCTURE_BOTTOM_FIELD);
+
+	cache_flush_range(yuv->data, 0, vs->layout.size);
+
+	return yuv;
+}
+
+static int same_size(const VdpRect *a, const VdpRect *b)
+{
+	return a->x1 - a->x0 == b->x1 - b->x0 && a->y1 - a->y0 == b->y1 - b->y0;
+}
+
+// composites the part of the background within the band into the OSD
+static void render_background_band(output_surface_ctx_t *os, output_surface_ctx_t *bg, const VdpRect *src, const VdpRect *dst,
+                                   uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+	VdpRect band = { max(x0, dst->x0), max(y0, dst->y0), min(x1, dst->x1), min(y1, dst->y1) };
+
+	if (band.x0 >= band.x1 || band.y0 >= band.y1)
+		return;
+
+	uint32_t src_width = src->x1 - src->x0, src_height = src->y1 - src->y0;
+	uint32_t dst_width = dst->x1 - dst->x0, dst_height = dst->y1 - dst->y0;
+	VdpRect band_src = { src->x0 + (band.x0 - dst->x0) * src_width / dst_width,
+	                     src->y0 + (band.y0 - dst->y0) * src_height / dst_height,
+	                     src->x0 + (band.x1 - dst->x0) * src_width / dst_width,
+	                     src->y0 + (band.y1 - dst->y0) * src_height / dst_height };
+
+	rgba_render_surface(&os->rgba, &band, &bg->rgba, &band_src, NULL, NULL, 0);
+}
+
+mixer_layer_t *mixer_layer_ref(mixer_layer_t *layer)
+{
+	layer->ref_count++;
+	return layer;
+}
+
+void mixer_layer_unref(mixer_layer_t *layer)
+{
+	layer->ref_count--;
+
+	if (layer->ref_count == 0)
+	{
+		rgba_destroy(&layer->rgba);
+		free(layer);
+	}
+}
+
+/*
+ * Copies the source rect of a layer surface into a layer of the output
+ * surface's pool for that slot. VDPAU mixes at render time, so the client
+ * may change or destroy the source right after. Copies still queued or
+ * on screen can't be reused, if all are, the layer gets composited.
+ */
+static int copy_layer(mixer_ctx_t *mix, output_surface_ctx_t *os, unsigned int slot,
+                      output_surface_ctx_t *source, const VdpRect *src, const VdpRect *dst)
+{
+	uint32_t width = src->x1 - src->x0, height = src->y1 - src->y0;
+	mixer_layer_t **copies = os->layer_copies[slot];
+	mixer_layer_t *layer;
+	int i;
+
+	for (i = 0; i < MIXER_LAYER_COPIES; i++)
+		if (!copies[i] || copies[i]->ref_count == 1)
+			break;
+
+	if (i == MIXER_LAYER_COPIES)
+	{
+		VDPAU_DBG_ONCE("All layer copies in use, compositing into the OSD");
+		return 0;
+	}
+
+	layer = copies[i];
+	if (layer && (layer->rgba.width != width || layer->rgba.height != height ||
+	              layer->rgba.format != source->rgba.format))
+	{
+		mixer_layer_unref(layer);
+		layer = copies[i] = NULL;
+	}
+
+	if (!layer)
+	{
+		layer = calloc(1, sizeof(*layer));
+		if (!layer)
+			return 0;
+
+		layer->ref_count = 1;
+		if (rgba_create(&layer->rgba, mix->device, width, height, source->rgba.format, 1) != VDP_STATUS_OK)
+		{
+			free(layer);
+			return 0;
+		}
+		copies[i] = layer;
+	}
+
+	rgba_clear(&layer->rgba);
+	if (rgba_render_surface(&layer->rgba, NULL, &source->rgba, src, NULL, NULL, 0) != VDP_STATUS_OK)
+		return 0;
+
+	layer->dst = *dst;
+	os->layers[slot] = layer;
+	return 1;
+}
+
+/*
+ * The background and the layers get the extra display layers all
+ * presentation targets have, as long as they need no scaling and, for
+ * the background, the display can stack one below the video. The OSD
+ * is above all of them, so once something is composited into it, the
+ * following layers have to be composited too. Empty layer surfaces
+ * aren't shown at all.
+ */
+static void mix_layers(mixer_ctx_t *mix, output_surface_ctx_t *os,
+                       VdpOutputSurface background_surface, VdpRect const *background_source_rect,
+                       VdpRect const *destination_rect, uint32_t layer_count, VdpLayer const *layers)
+{
+	unsigned int extra_layers = mix->device->disp ? mix->device->disp->extra_layers : 0;
+	int background_layer = mix->device->disp && mix->device->disp->background_layer;
+	VdpRect full = { 0, 0, os->rgba.width, os->rgba.height };
+	unsigned int used = 0, slot;
+	uint32_t i;
+
+	// slot 0 is below the video if the display has such a layer, the others above
+	slot = background_layer ? 1 : 0;
+
+	output_surface_ctx_t *bg = handle_get(background_surface);
+	if (bg && (bg->rgba.flags & RGBA_FLAG_DIRTY) && !(bg->rgba.flags & RGBA_FLAG_NEEDS_CLEAR))
+	{
+		VdpRect src = { 0, 0, bg->rgba.width, bg->rgba.height };
+		VdpRect dst = destination_rect ? *destination_rect : full;
+		if (background_source_rect)
+			src = *background_source_rect;
+
+		if (background_layer && extra_layers > 0 && same_size(&src, &dst) && copy_layer(mix, os, 0, bg, &src, &dst))
+		{
+			used |= 1 << 0;
+		}
+		else if (dst.x1 > dst.x0 && dst.y1 > dst.y0)
+		{
+			// the video covers the rest
+			const VdpRect *v = &os->video_dst_rect;
+			render_background_band(os, bg, &src, &dst, dst.x0, dst.y0, dst.x1, v->y0);
+			render_background_band(os, bg, &src, &dst, dst.x0, v->y0, v->x0, v->y1);
+			render_background_band(os, bg, &src, &dst, v->x1, v->y0, dst.x1, v->y1);
+			render_background_band(os, bg, &src, &dst, dst.x0, v->y1, dst.x1, dst.y1);
+			slot = extra_layers;
+		}
+	}
+
+	for (i = 0; i < layer_count; i++)
+	{
+		output_surface_ctx_t *ls = handle_get(layers[i].source_surface);
+		if (!ls || !(ls->rgba.flags & RGBA_FLAG_DIRTY) || (ls->rgba.flags & RGBA_FLAG_NEEDS_CLEAR))
+			continue;
+
+		VdpRect src = { 0, 0, ls->rgba.width, ls->rgba.height };
+		VdpRect dst = full;
+		if (layers[i].source_rect)
+			src = *layers[i].source_rect;
+		if (layers[i].destination_rect)
+			dst = *layers[i].destination_rect;
+
+		if (slot < extra_layers && same_size(&src, &dst) && copy_layer(mix, os, slot, ls, &src, &dst))
+		{
+			used |= 1 << slot++;
+		}
+		else
+		{
+			rgba_render_surface(&os->rgba, &dst, &ls->rgba, &src, NULL, NULL, 0);
+			slot = extra_layers;
+		}
+	}
+
+	// the pools of slots not used anymore are freed once off screen
+	for (slot = 0; slot < SUNXI_DISP_MAX_EXTRA_LAYERS; slot++)
+	{
+		if (used & (1 << slot))
+			continue;
+
+		os->layers[slot] = NULL;
+		for (i = 0; i < MIXER_LAYER_COPIES; i++)
+		{
+			if (os->layer_copies[slot][i])
+				mixer_layer_unref(os->layer_copies[slot][i]);
+			os->layer_copies[slot][i] = NULL;
+		}
+	}
+}
+
 VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
                                  VdpOutputSurface background_surface,
                                  VdpRect const *background_source_rect,
@@ -76,27 +391,20 @@ VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
 	if (!mix)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	if (background_surface != VDP_INVALID_HANDLE)
-		VDPAU_DBG_ONCE("Requested unimplemented background_surface");
-
-
-	if (current_picture_structure != VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME)
-		VDPAU_DBG_ONCE("Requested unimplemented picture_structure");
-
-
-
 	output_surface_ctx_t *os = handle_get(destination_surface);
 	if (!os)
 		return VDP_STATUS_INVALID_HANDLE;
 
 	if (os->yuv)
 		yuv_unref(os->yuv);
+	os->yuv = NULL;
 
-	os->vs = handle_get(video_surface_current);
-	if (!(os->vs))
+	video_surface_ctx_t *vs = handle_get(video_surface_current);
+	if (!vs)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	os->yuv = yuv_ref(os->vs->yuv);
+	if (vs->mapped)
+		return VDP_STATUS_ERROR;
 
 	if (video_source_rect)
 	{
@@ -105,9 +413,20 @@ VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
 	else
 	{
 		os->video_src_rect.x0 = os->video_src_rect.y0 = 0;
-		os->video_src_rect.x1 = os->vs->width;
-		os->video_src_rect.y1 = os->vs->height;
+		os->video_src_rect.x1 = vs->width;
+		os->video_src_rect.y1 = vs->height;
 	}
+
+	// fields are shown at field rate as the client presents them, bob if not deinterlaced
+	VdpVideoMixerPictureStructure field = current_picture_structure;
+	os->yuv = deinterlace(mix, vs, current_picture_structure,
+	                      video_surface_past_count, video_surface_past,
+	                      video_surface_future_count, video_surface_future);
+	if (os->yuv)
+		field = VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME;
+	else
+		os->yuv = yuv_ref(vs->yuv);
+
 	if (destination_video_rect)
 	{
 		os->video_dst_rect = *destination_video_rect;
@@ -119,6 +438,8 @@ VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
 		os->video_dst_rect.y1 = os->video_src_rect.y1 - os->video_src_rect.y0;
 	}
 
+	video_surface_scanout(vs, field, os);
+
 	os->csc_change = mix->csc_change;
 	os->brightness = mix->brightness;
 	os->contrast = mix->contrast;
@@ -129,9 +450,10 @@ VdpStatus vdp_video_mixer_render(VdpVideoMixer mixer,
 	if (mix->device->osd_enabled && (os->rgba.flags & RGBA_FLAG_DIRTY))
 		os->rgba.flags |= RGBA_FLAG_NEEDS_CLEAR;
 
-	if (layer_count != 0)
-		VDPAU_DBG_ONCE("Requested unimplemented additional layers");
-
+	if (mix->device->osd_enabled)
+		mix_layers(mix, os, background_surface, background_source_rect, destination_rect, layer_count, layers);
+	else if (background_surface != VDP_INVALID_HANDLE || layer_count != 0)
+		VDPAU_DBG_ONCE("Background surface and layers need OSD support");
 
 	return VDP_STATUS_OK;
 }
@@ -151,8 +473,11 @@ VdpStatus vdp_video_mixer_get_feature_support(VdpVideoMixer mixer,
 	if (!mix)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	uint32_t i;
+	for (i = 0; i < feature_count; i++)
+		feature_supports[i] = features[i] == VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL && mix->deinterlace_requested;
 
-	return VDP_STATUS_ERROR;
+	return VDP_STATUS_OK;
 }
 
 VdpStatus vdp_video_mixer_set_feature_enables(VdpVideoMixer mixer,
@@ -170,6 +495,14 @@ VdpStatus vdp_video_mixer_set_feature_enables(VdpVideoMixer mixer,
 	if (!mix)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	// only features requested at creation can be switched
+	uint32_t i;
+	for (i = 0; i < feature_count; i++)
+		if (features[i] != VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL || !mix->deinterlace_requested)
+			return VDP_STATUS_INVALID_VIDEO_MIXER_FEATURE;
+
+	for (i = 0; i < feature_count; i++)
+		mix->deinterlace = feature_enables[i];
 
 	return VDP_STATUS_OK;
 }
@@ -186,8 +519,11 @@ VdpStatus vdp_video_mixer_get_feature_enables(VdpVideoMixer mixer,
 	if (!mix)
 		return VDP_STATUS_INVALID_HANDLE;
 
+	uint32_t i;
+	for (i = 0; i < feature_count; i++)
+		feature_enables[i] = features[i] == VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL && mix->deinterlace;
 
-	return VDP_STATUS_ERROR;
+	return VDP_STATUS_OK;
 }
 
 static void set_csc_matrix(mixer_ctx_t *mix, const VdpCSCMatrix *matrix)
@@ -273,7 +609,7 @@ VdpStatus vdp_video_mixer_query_feature_support(VdpDevice device,
 	if (!dev)
 		return VDP_STATUS_INVALID_HANDLE;
 
-	*is_supported = VDP_FALSE;
+	*is_supported = feature == VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL;
 	return VDP_STATUS_OK;
 }
 
@@ -0,0 +1,559 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <string.h>
+#include "vdpau_private.h"
+#include "yuv_convert.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+/*
+ * Row kernels, NEON handles blocks of 16 pixels (pixel pairs for the
+ * packed formats), the C loops do the rest or everything without NEON.
+ * Odd widths have a last chroma sample and pixel pair for one pixel.
+ */
+
+static void interleave_row(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int n)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= n; i += 16)
+	{
+		uint8x16x2_t t;
+		t.val[0] = vld1q_u8(u + i);
+		t.val[1] = vld1q_u8(v + i);
+		vst2q_u8(uv + 2 * i, t);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		uv[2 * i] = u[i];
+		uv[2 * i + 1] = v[i];
+	}
+}
+
+static void deinterleave_row(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= n; i += 16)
+	{
+		uint8x16x2_t t = vld2q_u8(uv + 2 * i);
+		vst1q_u8(u + i, t.val[0]);
+		vst1q_u8(v + i, t.val[1]);
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+// packed byte order is Y0 U Y1 V for YUYV and U Y0 V Y1 for UYVY
+static void pack_422_row(uint8_t *dst, const uint8_t *y, const uint8_t *u,
+                         const uint8_t *v, unsigned int pairs, int uyvy)
+{
+	const int yo = uyvy ? 1 : 0, co = uyvy ? 0 : 1;
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= pairs; i += 16)
+	{
+		uint8x16x2_t l = vld2q_u8(y + 2 * i);
+		uint8x16x4_t t;
+		t.val[yo] = l.val[0];
+		t.val[yo + 2] = l.val[1];
+		t.val[co] = vld1q_u8(u + i);
+		t.val[co + 2] = vld1q_u8(v + i);
+		vst4q_u8(dst + 4 * i, t);
+	}
+#endif
+
+	for (; i < pairs; i++)
+	{
+		dst[4 * i + yo] = y[2 * i];
+		dst[4 * i + yo + 2] = y[2 * i + 1];
+		dst[4 * i + co] = u[i];
+		dst[4 * i + co + 2] = v[i];
+	}
+}
+
+static void pack_422_nv12_row(uint8_t *dst, const uint8_t *y, const uint8_t *uv,
+                              unsigned int pairs, int uyvy)
+{
+	const int yo = uyvy ? 1 : 0, co = uyvy ? 0 : 1;
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= pairs; i += 16)
+	{
+		uint8x16x2_t l = vld2q_u8(y + 2 * i);
+		uint8x16x2_t c = vld2q_u8(uv + 2 * i);
+		uint8x16x4_t t;
+		t.val[yo] = l.val[0];
+		t.val[yo + 2] = l.val[1];
+		t.val[co] = c.val[0];
+		t.val[co + 2] = c.val[1];
+		vst4q_u8(dst + 4 * i, t);
+	}
+#endif
+
+	for (; i < pairs; i++)
+	{
+		dst[4 * i + yo] = y[2 * i];
+		dst[4 * i + yo + 2] = y[2 * i + 1];
+		dst[4 * i + co] = uv[2 * i];
+		dst[4 * i + co + 2] = uv[2 * i + 1];
+	}
+}
+
+// YUYV <-> UYVY, swaps the bytes of each 16 bit word
+static void swap_422_row(uint8_t *dst, const uint8_t *src, unsigned int pairs)
+{
+	unsigned int i = 0, words = 2 * pairs;
+
+#ifdef HAVE_NEON
+	for (; i + 8 <= words; i += 8)
+		vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+#endif
+
+	for (; i < words; i++)
+	{
+		uint8_t t = src[2 * i];
+		dst[2 * i] = src[2 * i + 1];
+		dst[2 * i + 1] = t;
+	}
+}
+
+static void unpack_422_luma_row(uint8_t *y, const uint8_t *src, unsigned int pairs, int uyvy)
+{
+	const int yo = uyvy ? 1 : 0;
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= pairs; i += 16)
+	{
+		uint8x16x4_t t = vld4q_u8(src + 4 * i);
+		uint8x16x2_t l;
+		l.val[0] = t.val[yo];
+		l.val[1] = t.val[yo + 2];
+		vst2q_u8(y + 2 * i, l);
+	}
+#endif
+
+	for (; i < pairs; i++)
+	{
+		y[2 * i] = src[4 * i + yo];
+		y[2 * i + 1] = src[4 * i + yo + 2];
+	}
+}
+
+// averages the chroma of two packed lines into one 4:2:0 chroma line
+static void unpack_422_chroma_row(uint8_t *u, uint8_t *v, const uint8_t *src0,
+                                  const uint8_t *src1, unsigned int pairs, int uyvy)
+{
+	const int co = uyvy ? 0 : 1;
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= pairs; i += 16)
+	{
+		uint8x16x4_t a = vld4q_u8(src0 + 4 * i);
+		uint8x16x4_t b = vld4q_u8(src1 + 4 * i);
+		vst1q_u8(u + i, vrhaddq_u8(a.val[co], b.val[co]));
+		vst1q_u8(v + i, vrhaddq_u8(a.val[co + 2], b.val[co + 2]));
+	}
+#endif
+
+	for (; i < pairs; i++)
+	{
+		u[i] = (src0[4 * i + co] + src1[4 * i + co] + 1) >> 1;
+		v[i] = (src0[4 * i + co + 2] + src1[4 * i + co + 2] + 1) >> 1;
+	}
+}
+
+// same for NV12, the averaged chroma gets interleaved
+static void unpack_422_nv12_chroma_row(uint8_t *uv, const uint8_t *src0,
+                                       const uint8_t *src1, unsigned int pairs, int uyvy)
+{
+	const int co = uyvy ? 0 : 1;
+	unsigned int i = 0;
+
+#ifdef HAVE_NEON
+	for (; i + 16 <= pairs; i += 16)
+	{
+		uint8x16x4_t a = vld4q_u8(src0 + 4 * i);
+		uint8x16x4_t b = vld4q_u8(src1 + 4 * i);
+		uint8x16x2_t t;
+		t.val[0] = vrhaddq_u8(a.val[co], b.val[co]);
+		t.val[1] = vrhaddq_u8(a.val[co + 2], b.val[co + 2]);
+		vst2q_u8(uv + 2 * i, t);
+	}
+#endif
+
+	for (; i < pairs; i++)
+	{
+		uv[2 * i] = (src0[4 * i + co] + src1[4 * i + co] + 1) >> 1;
+		uv[2 * i + 1] = (src0[4 * i + co + 2] + src1[4 * i + co + 2] + 1) >> 1;
+	}
+}
+
+/*
+ * Plane converters
+ */
+
+static void copy_plane(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+                       uint32_t src_pitch, uint32_t bytes, uint32_t height)
+{
+	uint32_t i;
+
+	if (height == 0)
+		return;
+
+	if (dst_pitch == src_pitch)
+	{
+		memcpy(dst, src, src_pitch * (height - 1) + bytes);
+		return;
+	}
+
+	for (i = 0; i < height; i++)
+	{
+		memcpy(dst, src, bytes);
+		src += src_pitch;
+		dst += dst_pitch;
+	}
+}
+
+static void planar_to_planar(uint8_t *const *dst, uint32_t const *dst_pitches,
+                             const uint8_t *const *src, uint32_t const *src_pitches,
+                             uint32_t width, uint32_t height)
+{
+	copy_plane(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height);
+	copy_plane(dst[1], dst_pitches[1], src[1], src_pitches[1], DIV_ROUND_UP(width, 2), DIV_ROUND_UP(height, 2));
+	copy_plane(dst[2], dst_pitches[2], src[2], src_pitches[2], DIV_ROUND_UP(width, 2), DIV_ROUND_UP(height, 2));
+}
+
+static void nv12_to_nv12(uint8_t *const *dst, uint32_t const *dst_pitches,
+                         const uint8_t *const *src, uint32_t const *src_pitches,
+                         uint32_t width, uint32_t height)
+{
+	copy_plane(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height);
+	copy_plane(dst[1], dst_pitches[1], src[1], src_pitches[1], ALIGN(width, 2), DIV_ROUND_UP(height, 2));
+}
+
+static void packed_to_packed(uint8_t *const *dst, uint32_t const *dst_pitches,
+                             const uint8_t *const *src, uint32_t const *src_pitches,
+                             uint32_t width, uint32_t height)
+{
+	copy_plane(dst[0], dst_pitches[0], src[0], src_pitches[0], 2 * ALIGN(width, 2), height);
+}
+
+static void planar_to_nv12(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	uint32_t i;
+
+	copy_plane(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height);
+
+	for (i = 0; i < DIV_ROUND_UP(height, 2); i++)
+		interleave_row(dst[1] + i * dst_pitches[1], src[1] + i * src_pitches[1],
+			       src[2] + i * src_pitches[2], DIV_ROUND_UP(width, 2));
+}
+
+static void nv12_to_planar(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	uint32_t i;
+
+	copy_plane(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height);
+
+	for (i = 0; i < DIV_ROUND_UP(height, 2); i++)
+		deinterleave_row(dst[1] + i * dst_pitches[1], dst[2] + i * dst_pitches[2],
+				 src[1] + i * src_pitches[1], DIV_ROUND_UP(width, 2));
+}
+
+static void planar_to_packed(uint8_t *const *dst, uint32_t const *dst_pitches,
+                             const uint8_t *const *src, uint32_t const *src_pitches,
+                             uint32_t width, uint32_t height, int uyvy)
+{
+	uint32_t i;
+
+	/*
+	 * 4:2:0 to 4:2:2, every chroma line is used for two luma lines. The
+	 * surface is the source, a last odd pixel pairs with its padding.
+	 */
+	for (i = 0; i < height; i++)
+		pack_422_row(dst[0] + i * dst_pitches[0], src[0] + i * src_pitches[0],
+			     src[1] + (i / 2) * src_pitches[1], src[2] + (i / 2) * src_pitches[2],
+			     DIV_ROUND_UP(width, 2), uyvy);
+}
+
+// the luma destination may be a client buffer, no room for a whole last pair
+static void unpack_422_luma(uint8_t *dst, uint32_t dst_pitch, const uint8_t *src,
+                            uint32_t src_pitch, uint32_t width, uint32_t height, int uyvy)
+{
+	uint32_t i;
+
+	for (i = 0; i < height; i++)
+	{
+		unpack_422_luma_row(dst + i * dst_pitch, src + i * src_pitch, width / 2, uyvy);
+		if (width & 1)
+			dst[i * dst_pitch + width - 1] = src[i * src_pitch + 2 * (width - 1) + (uyvy ? 1 : 0)];
+	}
+}
+
+// an odd last line has no partner to average with
+static const uint8_t *second_line(const uint8_t *src, uint32_t pitch, uint32_t i, uint32_t height)
+{
+	return src + min(2 * i + 1, height - 1) * pitch;
+}
+
+static void packed_to_planar(uint8_t *const *dst, uint32_t const *dst_pitches,
+                             const uint8_t *const *src, uint32_t const *src_pitches,
+                             uint32_t width, uint32_t height, int uyvy)
+{
+	uint32_t i;
+
+	unpack_422_luma(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height, uyvy);
+
+	// 4:2:2 to 4:2:0, average the chroma of each line pair
+	for (i = 0; i < DIV_ROUND_UP(height, 2); i++)
+		unpack_422_chroma_row(dst[1] + i * dst_pitches[1], dst[2] + i * dst_pitches[2],
+				      src[0] + (2 * i) * src_pitches[0],
+				      second_line(src[0], src_pitches[0], i, height),
+				      DIV_ROUND_UP(width, 2), uyvy);
+}
+
+static void packed_to_nv12(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height, int uyvy)
+{
+	uint32_t i;
+
+	unpack_422_luma(dst[0], dst_pitches[0], src[0], src_pitches[0], width, height, uyvy);
+
+	for (i = 0; i < DIV_ROUND_UP(height, 2); i++)
+		unpack_422_nv12_chroma_row(dst[1] + i * dst_pitches[1],
+					   src[0] + (2 * i) * src_pitches[0],
+					   second_line(src[0], src_pitches[0], i, height),
+					   DIV_ROUND_UP(width, 2), uyvy);
+}
+
+static void nv12_to_packed(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height, int uyvy)
+{
+	uint32_t i;
+
+	for (i = 0; i < height; i++)
+		pack_422_nv12_row(dst[0] + i * dst_pitches[0], src[0] + i * src_pitches[0],
+				  src[1] + (i / 2) * src_pitches[1], DIV_ROUND_UP(width, 2), uyvy);
+}
+
+static void swap_packed(uint8_t *const *dst, uint32_t const *dst_pitches,
+                        const uint8_t *const *src, uint32_t const *src_pitches,
+                        uint32_t width, uint32_t height)
+{
+	uint32_t i;
+
+	for (i = 0; i < height; i++)
+		swap_422_row(dst[0] + i * dst_pitches[0], src[0] + i * src_pitches[0], DIV_ROUND_UP(width, 2));
+}
+
+static void planar_to_yuyv(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	planar_to_packed(dst, dst_pitches, src, src_pitches, width, height, 0);
+}
+
+static void planar_to_uyvy(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	planar_to_packed(dst, dst_pitches, src, src_pitches, width, height, 1);
+}
+
+static void nv12_to_yuyv(uint8_t *const *dst, uint32_t const *dst_pitches,
+                         const uint8_t *const *src, uint32_t const *src_pitches,
+                         uint32_t width, uint32_t height)
+{
+	nv12_to_packed(dst, dst_pitches, src, src_pitches, width, height, 0);
+}
+
+static void nv12_to_uyvy(uint8_t *const *dst, uint32_t const *dst_pitches,
+                         const uint8_t *const *src, uint32_t const *src_pitches,
+                         uint32_t width, uint32_t height)
+{
+	nv12_to_packed(dst, dst_pitches, src, src_pitches, width, height, 1);
+}
+
+static void yuyv_to_planar(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	packed_to_planar(dst, dst_pitches, src, src_pitches, width, height, 0);
+}
+
+static void uyvy_to_planar(uint8_t *const *dst, uint32_t const *dst_pitches,
+                           const uint8_t *const *src, uint32_t const *src_pitches,
+                           uint32_t width, uint32_t height)
+{
+	packed_to_planar(dst, dst_pitches, src, src_pitches, width, height, 1);
+}
+
+static void yuyv_to_nv12(uint8_t *const *dst, uint32_t const *dst_pitches,
+                         const uint8_t *const *src, uint32_t const *src_pitches,
+                         uint32_t width, uint32_t height)
+{
+	packed_to_nv12(dst, dst_pitches, src, src_pitches, width, height, 0);
+}
+
+static void uyvy_to_nv12(uint8_t *const *dst, uint32_t const *dst_pitches,
+                         const uint8_t *const *src, uint32_t const *src_pitches,
+                         uint32_t width, uint32_t height)
+{
+	packed_to_nv12(dst, dst_pitches, src, src_pitches, width, height, 1);
+}
+
+static const struct
+{
+	VdpYCbCrFormat src_format;
+	VdpYCbCrFormat dst_format;
+	yuv_convert_func convert;
+} converters[] =
+{
+	{ VDP_YCBCR_FORMAT_YV12, VDP_YCBCR_FORMAT_YV12, planar_to_planar },
+	{ VDP_YCBCR_FORMAT_YV12, VDP_YCBCR_FORMAT_NV12, planar_to_nv12 },
+	{ VDP_YCBCR_FORMAT_YV12, VDP_YCBCR_FORMAT_YUYV, planar_to_yuyv },
+	{ VDP_YCBCR_FORMAT_YV12, VDP_YCBCR_FORMAT_UYVY, planar_to_uyvy },
+	{ VDP_YCBCR_FORMAT_NV12, VDP_YCBCR_FORMAT_NV12, nv12_to_nv12 },
+	{ VDP_YCBCR_FORMAT_NV12, VDP_YCBCR_FORMAT_YV12, nv12_to_planar },
+	{ VDP_YCBCR_FORMAT_NV12, VDP_YCBCR_FORMAT_YUYV, nv12_to_yuyv },
+	{ VDP_YCBCR_FORMAT_NV12, VDP_YCBCR_FORMAT_UYVY, nv12_to_uyvy },
+	{ VDP_YCBCR_FORMAT_YUYV, VDP_YCBCR_FORMAT_YUYV, packed_to_packed },
+	{ VDP_YCBCR_FORMAT_YUYV, VDP_YCBCR_FORMAT_UYVY, swap_packed },
+	{ VDP_YCBCR_FORMAT_YUYV, VDP_YCBCR_FORMAT_YV12, yuyv_to_planar },
+	{ VDP_YCBCR_FORMAT_YUYV, VDP_YCBCR_FORMAT_NV12, yuyv_to_nv12 },
+	{ VDP_YCBCR_FORMAT_UYVY, VDP_YCBCR_FORMAT_UYVY, packed_to_packed },
+	{ VDP_YCBCR_FORMAT_UYVY, VDP_YCBCR_FORMAT_YUYV, swap_packed },
+	{ VDP_YCBCR_FORMAT_UYVY, VDP_YCBCR_FORMAT_YV12, uyvy_to_planar },
+	{ VDP_YCBCR_FORMAT_UYVY, VDP_YCBCR_FORMAT_NV12, uyvy_to_nv12 },
+};
+
+yuv_convert_func yuv_get_converter(VdpYCbCrFormat src_format, VdpYCbCrFormat dst_format)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(converters); i++)
+		if (converters[i].src_format == src_format && converters[i].dst_format == dst_format)
+			return converters[i].convert;
+
+	return NULL;
+}
+
+#define CSC_SHIFT 12
+
+static int32_t csc_fixed(float value, int32_t limit)
+{
+	float f = value * (1 << CSC_SHIFT);
+	if (f > limit)
+		return limit;
+	if (f < -limit)
+		return -limit;
+	return (int32_t)(f < 0 ? f - 0.5f : f + 0.5f);
+}
+
+void yuv_csc_init(yuv_csc_t *csc, VdpCSCMatrix const *matrix)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+			csc->coef[i][j] = csc_fixed((*matrix)[i][j], INT16_MAX);
+		csc->offset[i] = csc_fixed((*matrix)[i][3] * 255, INT32_MAX >> 2);
+	}
+}
+
+static uint8_t csc_clamp(int32_t v)
+{
+	v = (v + (1 << (CSC_SHIFT - 1))) >> CSC_SHIFT;
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+#ifdef HAVE_NEON
+static uint8x8_t csc_channel(const yuv_csc_t *csc, int c, int16x8_t y, int16x8_t cb, int16x8_t cr)
+{
+	int32x4_t lo = vdupq_n_s32(csc->offset[c]);
+	int32x4_t hi = lo;
+
+	lo = vmlal_n_s16(lo, vget_low_s16(y), csc->coef[c][0]);
+	hi = vmlal_n_s16(hi, vget_high_s16(y), csc->coef[c][0]);
+	lo = vmlal_n_s16(lo, vget_low_s16(cb), csc->coef[c][1]);
+	hi = vmlal_n_s16(hi, vget_high_s16(cb), csc->coef[c][1]);
+	lo = vmlal_n_s16(lo, vget_low_s16(cr), csc->coef[c][2]);
+	hi = vmlal_n_s16(hi, vget_high_s16(cr), csc->coef[c][2]);
+
+	return vqmovn_u16(vcombine_u16(vqrshrun_n_s32(lo, CSC_SHIFT), vqrshrun_n_s32(hi, CSC_SHIFT)));
+}
+#endif
+
+void yuv_csc_row(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                 const uint8_t *a, unsigned int n, const yuv_csc_t *csc, int bgr)
+{
+	// output byte of the R, G and B matrix rows
+	const int r = bgr ? 2 : 0, b = bgr ? 0 : 2;
+	unsigned int x = 0;
+
+#ifdef HAVE_NEON
+	for (; x + 8 <= n; x += 8)
+	{
+		int16x8_t ys = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x)));
+		int16x8_t cbs = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(cb + x)));
+		int16x8_t crs = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(cr + x)));
+		uint8x8x4_t out;
+
+		out.val[r] = csc_channel(csc, 0, ys, cbs, crs);
+		out.val[1] = csc_channel(csc, 1, ys, cbs, crs);
+		out.val[b] = csc_channel(csc, 2, ys, cbs, crs);
+		out.val[3] = vld1_u8(a + x);
+		vst4_u8(dst + 4 * x, out);
+	}
+#endif
+
+	for (; x < n; x++)
+	{
+		int c;
+		for (c = 0; c < 3; c++)
+		{
+			int32_t v = csc->offset[c] + csc->coef[c][0] * y[x] + csc->coef[c][1] * cb[x] + csc->coef[c][2] * cr[x];
+			dst[4 * x + (c == 0 ? r : (c == 1 ? 1 : b))] = csc_clamp(v);
+		}
+		dst[4 * x + 3] = a[x];
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __YUV_CONVERT_H__
+#define __YUV_CONVERT_H__
+
+#include "vdpau_private.h"
+
+/*
+ * Planes are always passed in Y, Cb, Cr order (Y, CbCr for NV12 and a
+ * single plane for packed formats), so callers have to swap the chroma
+ * planes of VDPAU's YV12 themselves.
+ */
+typedef void (*yuv_convert_func)(uint8_t *const *dst, uint32_t const *dst_pitches,
+                                 const uint8_t *const *src, uint32_t const *src_pitches,
+                                 uint32_t width, uint32_t height);
+
+yuv_convert_func yuv_get_converter(VdpYCbCrFormat src_format, VdpYCbCrFormat dst_format);
+
+// VdpCSCMatrix in Q12 fixed point, scaled for 8 bit samples
+typedef struct
+{
+	int16_t coef[3][3];
+	int32_t offset[3];
+} yuv_csc_t;
+
+void yuv_csc_init(yuv_csc_t *csc, VdpCSCMatrix const *matrix);
+
+/*
+ * Converts n pixels with full resolution Y, Cb, Cr and alpha rows to
+ * 32 bit RGBA, bgr selects B8G8R8A8 instead of R8G8B8A8 byte order.
+ */
+void yuv_csc_row(uint8_t *dst, const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                 const uint8_t *a, unsigned int n, const yuv_csc_t *csc, int bgr);
+
+#endif